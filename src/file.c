@@ -72,7 +72,31 @@ rstto_file_get_property (
 
 static GObjectClass *parent_class = NULL;
 
-static GList *open_files = NULL;
+/* Interning table, maps every GFile to the RsttoFile
+ * that represents it. The values are RsttoFileEntry.
+ */
+static GHashTable *open_files = NULL;
+G_LOCK_DEFINE_STATIC (open_files);
+
+typedef struct _RsttoFileEntry RsttoFileEntry;
+
+struct _RsttoFileEntry
+{
+    /* Cleared as soon as the file starts being disposed,
+     * so a file that is going away is never handed out.
+     */
+    GWeakRef   r_file;
+
+    /* Only used to recognize the entry of a file */
+    RsttoFile *owner;
+};
+
+static void
+rstto_file_entry_free (RsttoFileEntry *entry)
+{
+    g_weak_ref_clear (&entry->r_file);
+    g_free (entry);
+}
 
 enum
 {
@@ -116,6 +140,15 @@ struct _RsttoFilePriv
     gchar *display_name;
     gchar *content_type;
 
+    /* Snapshot of the metadata, taken when the file was
+     * enumerated or first queried. It is only invalidated
+     * when the file changes.
+     */
+    gboolean info_valid;
+    guint64 modified_time;
+    goffset size;
+    gchar *fast_content_type;
+
     gchar *uri;
     gchar *path;
     gchar *collate_key;
@@ -124,7 +157,15 @@ struct _RsttoFilePriv
     GdkPixbuf *thumbnails[THUMBNAIL_SIZE_COUNT];
 
     ExifData *exif_data;
+    /* Extracted by the metadata-reader */
+    GdkPixbuf *exif_thumbnail;
+    gboolean exif_thumbnail_valid;
     RsttoImageOrientation orientation;
+    /* Set once the user picked the orientation */
+    gboolean orientation_picked;
+
+    gboolean metadata_valid;
+    RsttoFileMetadata metadata;
 };
 
 
@@ -172,11 +213,23 @@ rstto_file_dispose (GObject *object)
 {
     RsttoFile *r_file = RSTTO_FILE (object);
     gint i = 0;
+    RsttoFileEntry *entry = NULL;
 
     if (r_file->priv)
     {
         if (r_file->priv->file)
         {
+            /* Only remove the entry if it still belongs to this file,
+             * a new RsttoFile for the same GFile may have replaced it.
+             */
+            G_LOCK (open_files);
+            entry = g_hash_table_lookup (open_files, r_file->priv->file);
+            if ( NULL != entry && entry->owner == r_file )
+            {
+                g_hash_table_remove (open_files, r_file->priv->file);
+            }
+            G_UNLOCK (open_files);
+
             g_object_unref (r_file->priv->file);
             r_file->priv->file = NULL;
         }
@@ -190,6 +243,11 @@ rstto_file_dispose (GObject *object)
             g_free (r_file->priv->content_type);
             r_file->priv->content_type = NULL;
         }
+        if (r_file->priv->fast_content_type)
+        {
+            g_free (r_file->priv->fast_content_type);
+            r_file->priv->fast_content_type = NULL;
+        }
         if (r_file->priv->path)
         {
             g_free (r_file->priv->path);
@@ -215,6 +273,11 @@ rstto_file_dispose (GObject *object)
             exif_data_free (r_file->priv->exif_data);
             r_file->priv->exif_data = NULL;
         }
+        if (r_file->priv->exif_thumbnail)
+        {
+            g_object_unref (r_file->priv->exif_thumbnail);
+            r_file->priv->exif_thumbnail = NULL;
+        }
 
         for (i = 0; i < THUMBNAIL_SIZE_COUNT; ++i)
         {
@@ -227,8 +290,6 @@ rstto_file_dispose (GObject *object)
 
         g_free (r_file->priv);
         r_file->priv = NULL;
-
-        open_files = g_list_remove_all (open_files, r_file);
     }
 }
 
@@ -255,29 +316,45 @@ RsttoFile *
 rstto_file_new ( GFile *file )
 {
     RsttoFile *r_file = NULL;
-    GList *iter = open_files;
+    RsttoFileEntry *entry = NULL;
 
-    while ( NULL != iter )
+    G_LOCK (open_files);
+
+    if ( NULL == open_files )
     {
-        /* Check if the file is already opened, if so
-         * return that one.
-         */
-        r_file = RSTTO_FILE (iter->data);
-        if ( TRUE == g_file_equal (
-                r_file->priv->file,
-                file) )
+        open_files = g_hash_table_new_full (
+                g_file_hash,
+                (GEqualFunc) g_file_equal,
+                g_object_unref,
+                (GDestroyNotify) rstto_file_entry_free);
+    }
+
+    /* Check if the file is already opened, if so
+     * return that one.
+     */
+    entry = g_hash_table_lookup (open_files, file);
+    if ( NULL != entry )
+    {
+        r_file = g_weak_ref_get (&entry->r_file);
+        if ( NULL != r_file )
         {
-            g_object_ref (G_OBJECT (iter->data));
-            return (RsttoFile *)iter->data;
+            G_UNLOCK (open_files);
+            return r_file;
         }
-        iter = g_list_next (iter);
     }
 
     r_file = g_object_new (RSTTO_TYPE_FILE, NULL);
     r_file->priv->file = file;
     g_object_ref (file);
 
-    open_files = g_list_append (open_files, r_file);
+    entry = g_new0 (RsttoFileEntry, 1);
+    g_weak_ref_init (&entry->r_file, r_file);
+    entry->owner = r_file;
+
+    /* This replaces the entry of a file that is being disposed */
+    g_hash_table_replace (open_files, g_object_ref (file), entry);
+
+    G_UNLOCK (open_files);
 
     return r_file;
 }
@@ -313,30 +390,79 @@ rstto_file_equal ( RsttoFile *r_file_a, RsttoFile *r_file_b )
     return r_file_a == r_file_b;
 }
 
-const gchar *
-rstto_file_get_display_name ( RsttoFile *r_file )
+/**
+ * rstto_file_set_info:
+ * @r_file:
+ * @file_info: GFileInfo queried with RSTTO_FILE_INFO_ATTRIBUTES,
+ *             e.g. by a GFileEnumerator
+ *
+ * Take a snapshot of the metadata in @file_info,
+ * so it does not have to be queried again.
+ */
+void
+rstto_file_set_info ( RsttoFile *r_file, GFileInfo *file_info )
 {
-    GFileInfo *file_info = NULL;
     const gchar *display_name;
+    const gchar *content_type;
 
-    if ( NULL == r_file->priv->display_name )
+    display_name = g_file_info_get_display_name (file_info);
+    if ( NULL != display_name && NULL == r_file->priv->display_name )
+    {
+        r_file->priv->display_name = g_strdup (display_name);
+    }
+
+    content_type = g_file_info_get_attribute_string (
+            file_info,
+            G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE);
+    if ( NULL == content_type )
+    {
+        content_type = g_file_info_get_content_type (file_info);
+    }
+    g_free (r_file->priv->fast_content_type);
+    r_file->priv->fast_content_type = g_strdup (content_type);
+
+    r_file->priv->modified_time = g_file_info_get_attribute_uint64 (
+            file_info,
+            G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    r_file->priv->size = g_file_info_get_size (file_info);
+
+    r_file->priv->info_valid = TRUE;
+}
+
+/**
+ * rstto_file_load_info:
+ * @r_file:
+ *
+ * Query the metadata snapshot if there is none.
+ */
+static void
+rstto_file_load_info ( RsttoFile *r_file )
+{
+    GFileInfo *file_info = NULL;
+
+    if ( FALSE == r_file->priv->info_valid )
     {
         file_info = g_file_query_info (
                 r_file->priv->file,
-                G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME,
+                RSTTO_FILE_INFO_ATTRIBUTES,
                 0,
                 NULL,
                 NULL );
         if ( NULL != file_info )
         {
-            display_name = g_file_info_get_display_name (file_info);
-            if ( NULL != display_name )
-            {
-                r_file->priv->display_name = g_strdup (display_name);
-            }
+            rstto_file_set_info (r_file, file_info);
             g_object_unref (file_info);
         }
     }
+}
+
+const gchar *
+rstto_file_get_display_name ( RsttoFile *r_file )
+{
+    if ( NULL == r_file->priv->display_name )
+    {
+        rstto_file_load_info (r_file);
+    }
 
     return (const gchar *)r_file->priv->display_name;
 }
@@ -364,6 +490,43 @@ rstto_file_get_uri ( RsttoFile *r_file )
     return (const gchar *)r_file->priv->uri;
 }
 
+/**
+ * rstto_file_collate_key_new:
+ * @basename: Filename to compute the collate-key for
+ *
+ * This function does not touch any RsttoFile, so it can
+ * be called from a worker thread.
+ *
+ * Return value: Newly allocated collate-key, free with g_free
+ */
+gchar *
+rstto_file_collate_key_new ( const gchar *basename )
+{
+    gchar *collate_key = NULL;
+
+    if ( g_utf8_validate (basename, -1, NULL) )
+    {
+        /* If we can use casefold for case insenstivie sorting, then
+         * do so */
+        gchar *casefold = g_utf8_casefold (basename, -1);
+        if ( NULL != casefold )
+        {
+            collate_key = g_utf8_collate_key_for_filename (casefold, -1);
+            g_free (casefold);
+        }
+        else
+        {
+            collate_key = g_utf8_collate_key_for_filename (basename, -1);
+        }
+    }
+    else
+    {
+        collate_key = g_strdup (basename);
+    }
+
+    return collate_key;
+}
+
 const gchar *
 rstto_file_get_collate_key ( RsttoFile *r_file )
 {
@@ -372,66 +535,131 @@ rstto_file_get_collate_key ( RsttoFile *r_file )
         gchar *basename = g_file_get_basename (rstto_file_get_file (r_file));
         if ( NULL != basename )
         {
-            if ( g_utf8_validate (basename, -1, NULL) )
-            {
-                /* If we can use casefold for case insenstivie sorting, then
-                 * do so */
-                gchar *casefold = g_utf8_casefold (basename, -1);
-                if ( NULL != casefold )
-                {
-                    r_file->priv->collate_key = g_utf8_collate_key_for_filename (casefold, -1);
-                    g_free (casefold);
-                }
-                else
-                {
-                    r_file->priv->collate_key = g_utf8_collate_key_for_filename (basename, -1);
-                }
-            }
-            else
-            {
-                r_file->priv->collate_key = g_strdup (basename);
-            }
+            r_file->priv->collate_key = rstto_file_collate_key_new (basename);
             g_free (basename);
         }
     }
     return (const gchar *)r_file->priv->collate_key;
 }
 
-const gchar *
-rstto_file_get_content_type ( RsttoFile *r_file )
+/**
+ * rstto_file_set_collate_key:
+ * @r_file:
+ * @collate_key: Collate-key computed with rstto_file_collate_key_new,
+ *               the file takes ownership of it
+ *
+ * Store a collate-key that was computed in advance,
+ * if the file does not have one yet.
+ */
+void
+rstto_file_set_collate_key ( RsttoFile *r_file, gchar *collate_key )
 {
-    const gchar *file_path, *content_type = NULL;
-
-    if ( NULL == r_file->priv->content_type )
+    if ( NULL == r_file->priv->collate_key )
+    {
+        r_file->priv->collate_key = collate_key;
+    }
+    else
     {
+        g_free (collate_key);
+    }
+}
+
 #if HAVE_MAGIC_H
-        magic_t magic = magic_open (MAGIC_MIME_TYPE | MAGIC_SYMLINK);
+static void
+rstto_file_magic_close (gpointer magic)
+{
+    magic_close ((magic_t) magic);
+}
+
+/* Loading the magic database is expensive, so every thread
+ * loads it once and keeps the cookie until it exits.
+ */
+static GPrivate rstto_file_magic = G_PRIVATE_INIT (rstto_file_magic_close);
+
+/**
+ * rstto_file_get_magic:
+ *
+ * Return value: The magic cookie of the calling thread,
+ *               NULL if the database could not be loaded.
+ */
+static magic_t
+rstto_file_get_magic (void)
+{
+    magic_t magic = g_private_get (&rstto_file_magic);
+
+    if ( NULL == magic )
+    {
+        magic = magic_open (MAGIC_MIME_TYPE | MAGIC_SYMLINK);
         if ( NULL != magic )
         {
-            file_path = rstto_file_get_path (r_file);
-            if ( NULL != file_path && magic_load (magic, NULL) == 0 )
+            if ( magic_load (magic, NULL) != 0 )
             {
-                content_type = magic_file (magic, file_path);
-                if ( NULL != content_type )
-                {
-                    /* image types that aren't supported by gdk_pixbuf_loader_new_with_mime_type () */
-                    if ( g_strcmp0 (content_type, "image/x-ms-bmp") == 0 )
-                    {
-                        content_type = "image/bmp"; // bug #13489
-                    }
-                    else if ( g_strcmp0 (content_type, "image/x-portable-greymap") == 0 )
-                    {
-                        content_type = "image/x-portable-graymap"; // bug #14709
-                    }
+                magic_close (magic);
+                return NULL;
+            }
+            g_private_set (&rstto_file_magic, magic);
+        }
+    }
+    return magic;
+}
+#endif
 
-                    r_file->priv->content_type = g_strdup (content_type);
-                }
+/**
+ * rstto_file_sniff_content_type:
+ * @file_path: Local path of the file, can be NULL
+ *
+ * Determine the content-type from the contents of the file.
+ * This function does not touch any RsttoFile, so it can
+ * be called from a worker thread.
+ *
+ * Return value: Newly allocated content-type, NULL if it could
+ *               not be determined.
+ */
+gchar *
+rstto_file_sniff_content_type ( const gchar *file_path )
+{
+    const gchar *content_type = NULL;
+#if HAVE_MAGIC_H
+    magic_t magic;
+
+    if ( NULL == file_path )
+    {
+        return NULL;
+    }
+
+    magic = rstto_file_get_magic ();
+    if ( NULL != magic )
+    {
+        content_type = magic_file (magic, file_path);
+        if ( NULL != content_type )
+        {
+            /* image types that aren't supported by gdk_pixbuf_loader_new_with_mime_type () */
+            if ( g_strcmp0 (content_type, "image/x-ms-bmp") == 0 )
+            {
+                content_type = "image/bmp"; // bug #13489
+            }
+            else if ( g_strcmp0 (content_type, "image/x-portable-greymap") == 0 )
+            {
+                content_type = "image/x-portable-graymap"; // bug #14709
             }
-            magic_close (magic);
         }
+    }
 #endif
 
-        if ( NULL == content_type )
+    return g_strdup (content_type);
+}
+
+const gchar *
+rstto_file_get_content_type ( RsttoFile *r_file )
+{
+    const gchar *content_type = NULL;
+
+    if ( NULL == r_file->priv->content_type )
+    {
+        r_file->priv->content_type = rstto_file_sniff_content_type (
+                rstto_file_get_path (r_file));
+
+        if ( NULL == r_file->priv->content_type )
         {
             GFileInfo *file_info = g_file_query_info (
                     r_file->priv->file,
@@ -454,30 +682,86 @@ rstto_file_get_content_type ( RsttoFile *r_file )
     return (const gchar *)r_file->priv->content_type;
 }
 
-guint64
-rstto_file_get_modified_time ( RsttoFile *r_file )
+/**
+ * rstto_file_set_content_type:
+ * @r_file:
+ * @content_type: Content-type from rstto_file_sniff_content_type,
+ *                the file takes ownership of it
+ *
+ * Store a content-type that was determined in the background.
+ */
+void
+rstto_file_set_content_type ( RsttoFile *r_file, gchar *content_type )
 {
-    guint64 time_ = 0;
-    GFileInfo *file_info = g_file_query_info (r_file->priv->file, "time::modified", 0, NULL, NULL);
+    if ( NULL == content_type )
+    {
+        return;
+    }
+    g_free (r_file->priv->content_type);
+    r_file->priv->content_type = content_type;
+}
 
-    time_ = g_file_info_get_attribute_uint64 ( file_info, "time::modified" );
+/**
+ * rstto_file_get_known_content_type:
+ * @r_file:
+ *
+ * Unlike rstto_file_get_content_type, this does not look at the
+ * contents of the file. Until the content-type is sniffed, the
+ * fast content-type of the enumerator is returned.
+ *
+ * Return value: The best content-type that is known without I/O
+ */
+const gchar *
+rstto_file_get_known_content_type ( RsttoFile *r_file )
+{
+    if ( NULL != r_file->priv->content_type )
+    {
+        return (const gchar *)r_file->priv->content_type;
+    }
+    return rstto_file_get_fast_content_type (r_file);
+}
 
-    g_object_unref (file_info);
+/**
+ * rstto_file_has_content_type:
+ * @r_file:
+ *
+ * Return value: TRUE if the content-type has been determined
+ */
+gboolean
+rstto_file_has_content_type ( RsttoFile *r_file )
+{
+    return ( NULL != r_file->priv->content_type );
+}
 
-    return time_;
+/**
+ * rstto_file_get_fast_content_type:
+ * @r_file:
+ *
+ * Return value: The content-type guessed from the filename,
+ *               as reported by the enumerator
+ */
+const gchar *
+rstto_file_get_fast_content_type ( RsttoFile *r_file )
+{
+    rstto_file_load_info (r_file);
+
+    return (const gchar *)r_file->priv->fast_content_type;
 }
 
-goffset
-rstto_file_get_size (RsttoFile *r_file )
+guint64
+rstto_file_get_modified_time ( RsttoFile *r_file )
 {
-    goffset size = 0;
-    GFileInfo *file_info = g_file_query_info (r_file->priv->file, G_FILE_ATTRIBUTE_STANDARD_SIZE, 0, NULL, NULL);
+    rstto_file_load_info (r_file);
 
-    size = g_file_info_get_size ( file_info );
+    return r_file->priv->modified_time;
+}
 
-    g_object_unref (file_info);
+goffset
+rstto_file_get_size (RsttoFile *r_file )
+{
+    rstto_file_load_info (r_file);
 
-    return size;
+    return r_file->priv->size;
 }
 
 ExifEntry *
@@ -527,12 +811,76 @@ rstto_file_get_orientation ( RsttoFile *r_file )
     return r_file->priv->orientation;
 }
 
+/**
+ * rstto_file_get_metadata:
+ * @r_file:
+ *
+ * Return value: The metadata record, or NULL if
+ *               the metadata has not been read yet.
+ */
+const RsttoFileMetadata *
+rstto_file_get_metadata ( RsttoFile *r_file )
+{
+    if ( FALSE == r_file->priv->metadata_valid )
+    {
+        return NULL;
+    }
+    return &r_file->priv->metadata;
+}
+
+void
+rstto_file_set_metadata (
+        RsttoFile *r_file,
+        const RsttoFileMetadata *metadata )
+{
+    r_file->priv->metadata = *metadata;
+    r_file->priv->metadata_valid = TRUE;
+
+    /* Spare reading the exif-data for the default orientation */
+    if ( r_file->priv->orientation == 0 && metadata->orientation != 0 )
+    {
+        r_file->priv->orientation = metadata->orientation;
+    }
+}
+
+/**
+ * rstto_file_get_sort_date:
+ * @r_file:
+ *
+ * Return value: The capture date if it is known, the
+ *               last-modification-time otherwise.
+ */
+gint64
+rstto_file_get_sort_date ( RsttoFile *r_file )
+{
+    if ( TRUE == r_file->priv->metadata_valid &&
+         r_file->priv->metadata.date_taken != 0 )
+    {
+        return r_file->priv->metadata.date_taken;
+    }
+    return (gint64) rstto_file_get_modified_time (r_file);
+}
+
 void
 rstto_file_set_orientation (
         RsttoFile *r_file ,
         RsttoImageOrientation orientation )
 {
     r_file->priv->orientation = orientation;
+    r_file->priv->orientation_picked = TRUE;
+}
+
+/**
+ * rstto_file_has_default_orientation:
+ * @r_file:
+ *
+ * Return value: TRUE if the orientation is the one stored in
+ *               the file, FALSE if it was picked by the user.
+ */
+gboolean
+rstto_file_has_default_orientation ( RsttoFile *r_file )
+{
+    return ( FALSE == r_file->priv->orientation_picked );
 }
 
 gboolean
@@ -549,6 +897,59 @@ rstto_file_has_exif ( RsttoFile *r_file )
     return TRUE;
 }
 
+/**
+ * rstto_file_get_exif_thumbnail:
+ * @r_file:
+ *
+ * The thumbnail is extracted by the metadata-reader, this
+ * does not read the file.
+ *
+ * Return value: (transfer none): The thumbnail that is embedded
+ *               in the EXIF data, or NULL if there is none or
+ *               it was not extracted yet.
+ */
+GdkPixbuf *
+rstto_file_get_exif_thumbnail ( RsttoFile *r_file )
+{
+    return r_file->priv->exif_thumbnail;
+}
+
+/**
+ * rstto_file_has_exif_thumbnail:
+ * @r_file:
+ *
+ * Return value: TRUE if the file was searched for an EXIF
+ *               thumbnail, even if it has none.
+ */
+gboolean
+rstto_file_has_exif_thumbnail ( RsttoFile *r_file )
+{
+    return r_file->priv->exif_thumbnail_valid;
+}
+
+/**
+ * rstto_file_set_exif_thumbnail:
+ * @r_file:
+ * @thumbnail: (allow-none): The thumbnail the metadata-reader
+ *                           extracted, NULL if there is none
+ */
+void
+rstto_file_set_exif_thumbnail (
+        RsttoFile *r_file,
+        GdkPixbuf *thumbnail )
+{
+    if ( NULL != thumbnail )
+    {
+        g_object_ref (thumbnail);
+    }
+    if ( NULL != r_file->priv->exif_thumbnail )
+    {
+        g_object_unref (r_file->priv->exif_thumbnail);
+    }
+    r_file->priv->exif_thumbnail = thumbnail;
+    r_file->priv->exif_thumbnail_valid = TRUE;
+}
+
 const gchar *
 rstto_file_get_thumbnail_path ( RsttoFile *r_file)
 {
@@ -630,6 +1031,16 @@ rstto_file_get_thumbnail (
 void
 rstto_file_changed ( RsttoFile *r_file )
 {
+    /* The metadata snapshot is outdated */
+    r_file->priv->info_valid = FALSE;
+    r_file->priv->metadata_valid = FALSE;
+    r_file->priv->exif_thumbnail_valid = FALSE;
+    if (r_file->priv->exif_thumbnail)
+    {
+        g_object_unref (r_file->priv->exif_thumbnail);
+        r_file->priv->exif_thumbnail = NULL;
+    }
+
     g_signal_emit (
             G_OBJECT (r_file),
             rstto_file_signals[RSTTO_FILE_SIGNAL_CHANGED],
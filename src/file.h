@@ -47,6 +47,15 @@ G_BEGIN_DECLS
         G_TYPE_CHECK_CLASS_TYPE ((klass), \
                 RSTTO_TYPE_FILE()))
 
+/* Attributes of the metadata snapshot, see rstto_file_set_info */
+#define RSTTO_FILE_INFO_ATTRIBUTES \
+        G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+        G_FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME "," \
+        G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE "," \
+        G_FILE_ATTRIBUTE_STANDARD_FAST_CONTENT_TYPE "," \
+        G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+        G_FILE_ATTRIBUTE_TIME_MODIFIED
+
 
 typedef struct _RsttoFile RsttoFile;
 typedef struct _RsttoFilePriv RsttoFilePriv;
@@ -59,12 +68,25 @@ struct _RsttoFile
 };
 
 typedef struct _RsttoFileClass RsttoFileClass;
+typedef struct _RsttoFileMetadata RsttoFileMetadata;
 
 struct _RsttoFileClass
 {
     GObjectClass parent_class;
 };
 
+/* Compact record of the image metadata, filled in
+ * by the metadata-reader.
+ */
+struct _RsttoFileMetadata
+{
+    /* Capture date in seconds since the epoch, 0 if unknown */
+    gint64                date_taken;
+    RsttoImageOrientation orientation;
+    gint                  width;
+    gint                  height;
+};
+
 RsttoFile *
 rstto_file_new ( GFile * );
 
@@ -89,9 +111,33 @@ rstto_file_get_uri ( RsttoFile * );
 const gchar *
 rstto_file_get_collate_key ( RsttoFile * );
 
+void
+rstto_file_set_collate_key ( RsttoFile *, gchar * );
+
+gchar *
+rstto_file_collate_key_new ( const gchar * );
+
 const gchar *
 rstto_file_get_content_type ( RsttoFile * );
 
+const gchar *
+rstto_file_get_fast_content_type ( RsttoFile * );
+
+const gchar *
+rstto_file_get_known_content_type ( RsttoFile * );
+
+gboolean
+rstto_file_has_content_type ( RsttoFile * );
+
+void
+rstto_file_set_content_type ( RsttoFile *, gchar * );
+
+gchar *
+rstto_file_sniff_content_type ( const gchar * );
+
+void
+rstto_file_set_info ( RsttoFile *, GFileInfo * );
+
 const gchar *
 rstto_file_get_thumbnail_path ( RsttoFile *);
 
@@ -110,14 +156,37 @@ rstto_file_get_exif ( RsttoFile *, ExifTag );
 RsttoImageOrientation
 rstto_file_get_orientation ( RsttoFile * );
 
+const RsttoFileMetadata *
+rstto_file_get_metadata ( RsttoFile * );
+
+void
+rstto_file_set_metadata ( RsttoFile *, const RsttoFileMetadata * );
+
+gint64
+rstto_file_get_sort_date ( RsttoFile * );
+
 void
 rstto_file_set_orientation (
         RsttoFile * ,
         RsttoImageOrientation );
 
+gboolean
+rstto_file_has_default_orientation ( RsttoFile * );
+
 gboolean
 rstto_file_has_exif ( RsttoFile * );
 
+GdkPixbuf *
+rstto_file_get_exif_thumbnail ( RsttoFile * );
+
+gboolean
+rstto_file_has_exif_thumbnail ( RsttoFile * );
+
+void
+rstto_file_set_exif_thumbnail (
+        RsttoFile *,
+        GdkPixbuf * );
+
 void
 rstto_file_changed ( RsttoFile * );
 
@@ -216,6 +216,16 @@ rstto_icon_bar_rows_reordered (
         gint         *new_order,
         RsttoIconBar *icon_bar);
 
+static void
+rstto_icon_bar_model_reset (
+        GtkTreeModel *model,
+        RsttoIconBar *icon_bar);
+
+static void
+rstto_icon_bar_rows_added (
+        GtkTreeModel *model,
+        RsttoIconBar *icon_bar);
+
 struct _RsttoIconBarItem
 {
     GtkTreeIter iter;
@@ -1506,6 +1516,95 @@ rstto_icon_bar_row_deleted (
 }
 
 
+/**
+ * rstto_icon_bar_model_reset:
+ * @model    : The model, it has dropped all of its rows.
+ * @icon_bar : An #RsttoIconBar.
+ *
+ * Drop all items at once, instead of handling a
+ * row-deleted signal for every single row.
+ **/
+static void
+rstto_icon_bar_model_reset (
+        GtkTreeModel *model,
+        RsttoIconBar *icon_bar)
+{
+    gboolean active;
+
+    g_return_if_fail (RSTTO_IS_ICON_BAR (icon_bar));
+
+    active = (icon_bar->priv->active_item != NULL);
+
+    g_list_free_full (icon_bar->priv->items, (GDestroyNotify) rstto_icon_bar_item_free);
+    icon_bar->priv->items = NULL;
+    icon_bar->priv->active_item = NULL;
+    icon_bar->priv->cursor_item = NULL;
+    icon_bar->priv->single_click_item = NULL;
+
+    gtk_widget_queue_resize (GTK_WIDGET (icon_bar));
+
+    if (active)
+        rstto_icon_bar_set_active (icon_bar, -1);
+}
+
+
+/**
+ * rstto_icon_bar_rows_added:
+ * @model    : The model, it has added a batch of rows.
+ * @icon_bar : An #RsttoIconBar.
+ *
+ * Rebuild the list of items in a single pass, instead of
+ * handling a row-inserted signal for every single row. The
+ * items of the rows that were there before are kept, the
+ * iters of the image-list persist and user_data tells the
+ * rows apart.
+ **/
+static void
+rstto_icon_bar_rows_added (
+        GtkTreeModel *model,
+        RsttoIconBar *icon_bar)
+{
+    RsttoIconBarItem *item;
+    GHashTable       *known;
+    GtkTreeIter       iter;
+    GList            *items = NULL;
+    GList            *lp;
+    gint              i = 0;
+
+    g_return_if_fail (RSTTO_IS_ICON_BAR (icon_bar));
+
+    known = g_hash_table_new (g_direct_hash, g_direct_equal);
+    for (lp = icon_bar->priv->items; lp != NULL; lp = lp->next)
+    {
+        item = lp->data;
+        g_hash_table_insert (known, item->iter.user_data, item);
+    }
+
+    if (gtk_tree_model_get_iter_first (model, &iter))
+    {
+        do
+        {
+            item = g_hash_table_lookup (known, iter.user_data);
+            if (item == NULL)
+            {
+                item = rstto_icon_bar_item_new ();
+                item->iter = iter;
+            }
+            item->index = i++;
+
+            items = g_list_prepend (items, item);
+        }
+        while (gtk_tree_model_iter_next (model, &iter));
+    }
+
+    g_hash_table_destroy (known);
+    g_list_free (icon_bar->priv->items);
+    icon_bar->priv->items = g_list_reverse (items);
+
+    gtk_widget_queue_resize (GTK_WIDGET (icon_bar));
+}
+
+
 static void
 rstto_icon_bar_rows_reordered (
         GtkTreeModel *model,
@@ -1535,7 +1634,7 @@ rstto_icon_bar_rows_reordered (
     for (i = 0; i < length; ++i)
     {
         item_array[i]->index = i;
-        items = g_list_append (items, item_array[i]);
+        items = g_list_prepend (items, item_array[i]);
     }
 
     g_list_free (icon_bar->priv->items);
@@ -1658,6 +1757,12 @@ rstto_icon_bar_set_model (
         g_signal_handlers_disconnect_by_func (icon_bar->priv->model,
                 rstto_icon_bar_rows_reordered,
                 icon_bar);
+        g_signal_handlers_disconnect_by_func (icon_bar->priv->model,
+                rstto_icon_bar_model_reset,
+                icon_bar);
+        g_signal_handlers_disconnect_by_func (icon_bar->priv->model,
+                rstto_icon_bar_rows_added,
+                icon_bar);
 
         g_object_unref (G_OBJECT (icon_bar->priv->model));
 
@@ -1682,6 +1787,24 @@ rstto_icon_bar_set_model (
         g_signal_connect (G_OBJECT (model), "rows-reordered",
                 G_CALLBACK (rstto_icon_bar_rows_reordered), icon_bar);
 
+        /* Models that can drop all rows at once, like the
+         * image-list, signal that with "remove-all".
+         */
+        if (g_signal_lookup ("remove-all", G_OBJECT_TYPE (model)) != 0)
+        {
+            g_signal_connect (G_OBJECT (model), "remove-all",
+                    G_CALLBACK (rstto_icon_bar_model_reset), icon_bar);
+        }
+
+        /* Likewise, "rows-added" replaces a row-inserted
+         * signal for every row of a batch.
+         */
+        if (g_signal_lookup ("rows-added", G_OBJECT_TYPE (model)) != 0)
+        {
+            g_signal_connect (G_OBJECT (model), "rows-added",
+                    G_CALLBACK (rstto_icon_bar_rows_added), icon_bar);
+        }
+
         rstto_icon_bar_build_items (icon_bar);
 
         if (icon_bar->priv->items != NULL)
@@ -0,0 +1,738 @@
+/*
+ *  Copyright (c) Stephan Arts 2006-2012 <stephan@xfce.org>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <gtk/gtk.h>
+
+#include "util.h"
+#include "file.h"
+#include "settings.h"
+#include "image_decoder.h"
+#include "image_cache.h"
+
+static void
+rstto_image_cache_init (GObject *);
+static void
+rstto_image_cache_class_init (GObjectClass *);
+
+static void
+rstto_image_cache_dispose (GObject *object);
+static void
+rstto_image_cache_finalize (GObject *object);
+
+static void
+cb_rstto_image_cache_decode_ready (
+        GObject *source_object,
+        GAsyncResult *result,
+        gpointer user_data);
+
+static void
+cb_rstto_image_cache_size_changed (
+        GObject *settings,
+        GParamSpec *pspec,
+        gpointer user_data);
+
+static GObjectClass *parent_class = NULL;
+
+static RsttoImageCache *image_cache_object;
+
+enum
+{
+    RSTTO_IMAGE_CACHE_SIGNAL_READY = 0,
+    RSTTO_IMAGE_CACHE_SIGNAL_COUNT
+};
+
+static gint rstto_image_cache_signals[RSTTO_IMAGE_CACHE_SIGNAL_COUNT];
+
+GType
+rstto_image_cache_get_type (void)
+{
+    static GType rstto_image_cache_type = 0;
+
+    if (!rstto_image_cache_type)
+    {
+        static const GTypeInfo rstto_image_cache_info = 
+        {
+            sizeof (RsttoImageCacheClass),
+            (GBaseInitFunc) NULL,
+            (GBaseFinalizeFunc) NULL,
+            (GClassInitFunc) rstto_image_cache_class_init,
+            (GClassFinalizeFunc) NULL,
+            NULL,
+            sizeof (RsttoImageCache),
+            0,
+            (GInstanceInitFunc) rstto_image_cache_init,
+            NULL
+        };
+
+        rstto_image_cache_type = g_type_register_static (
+                G_TYPE_OBJECT,
+                "RsttoImageCache",
+                &rstto_image_cache_info,
+                0);
+    }
+    return rstto_image_cache_type;
+}
+
+/* A decoded image is identified by the file, the size
+ * it was limited to while decoding (0 for no limit) and
+ * the orientation it was decoded for.
+ */
+typedef struct _RsttoImageCacheKey RsttoImageCacheKey;
+
+struct _RsttoImageCacheKey
+{
+    RsttoFile             *file;
+    gint                   max_width;
+    gint                   max_height;
+    RsttoImageOrientation  orientation;
+};
+
+typedef struct _RsttoImageCacheEntry RsttoImageCacheEntry;
+
+struct _RsttoImageCacheEntry
+{
+    /* Has to be the first member, the entry is its own hash-key */
+    RsttoImageCacheKey  key;
+
+    RsttoImageCache    *cache;
+    GdkPixbufAnimation *animation;
+    gint                image_width;
+    gint                image_height;
+    gdouble             image_scale;
+
+    /* Orientation to show the image in, it differs from the
+     * one of the key if the decoder turned it upright.
+     */
+    RsttoImageOrientation image_orientation;
+
+    /* Number of bytes held by the animation */
+    gsize               size;
+
+    /* Link in the lru-queue, the head is used most recently */
+    GList              *link;
+};
+
+typedef struct _RsttoImageCacheJob RsttoImageCacheJob;
+
+struct _RsttoImageCacheJob
+{
+    /* Has to be the first member, the job is its own hash-key */
+    RsttoImageCacheKey  key;
+
+    RsttoImageCache    *cache;
+    GCancellable       *cancellable;
+
+    /* Prefetch-generation that last asked for this job */
+    guint               generation;
+};
+
+struct _RsttoImageCachePriv
+{
+    RsttoSettings     *settings;
+    RsttoImageDecoder *decoder;
+
+    /* RsttoImageCacheEntry, owned by the table */
+    GHashTable    *entries;
+    GQueue        *lru;
+    gsize          size;
+    gsize          budget;
+
+    /* Prefetch-jobs that are queued or being decoded */
+    GHashTable    *jobs;
+    guint          generation;
+};
+
+static guint
+rstto_image_cache_key_hash (gconstpointer data)
+{
+    const RsttoImageCacheKey *key = data;
+
+    return g_direct_hash (key->file) ^
+           ((guint) key->max_width << 16) ^
+           (guint) key->max_height ^
+           ((guint) key->orientation << 28);
+}
+
+static gboolean
+rstto_image_cache_key_equal (gconstpointer a, gconstpointer b)
+{
+    const RsttoImageCacheKey *key_a = a;
+    const RsttoImageCacheKey *key_b = b;
+
+    return key_a->file == key_b->file &&
+           key_a->max_width == key_b->max_width &&
+           key_a->max_height == key_b->max_height &&
+           key_a->orientation == key_b->orientation;
+}
+
+static void
+rstto_image_cache_entry_free (RsttoImageCacheEntry *entry);
+
+static void
+rstto_image_cache_init (GObject *object)
+{
+    RsttoImageCache *cache = RSTTO_IMAGE_CACHE (object);
+    guint            cache_size = 0;
+
+    cache->priv = g_new0 (RsttoImageCachePriv, 1);
+    cache->priv->settings = rstto_settings_new ();
+    cache->priv->decoder = rstto_image_decoder_new ();
+    cache->priv->entries = g_hash_table_new_full (
+            rstto_image_cache_key_hash,
+            rstto_image_cache_key_equal,
+            NULL,
+            (GDestroyNotify) rstto_image_cache_entry_free);
+    cache->priv->lru = g_queue_new ();
+    cache->priv->jobs = g_hash_table_new (
+            rstto_image_cache_key_hash,
+            rstto_image_cache_key_equal);
+
+    g_object_get (
+            G_OBJECT (cache->priv->settings),
+            "image-cache-size", &cache_size,
+            NULL);
+    cache->priv->budget = (gsize) cache_size * 1024 * 1024;
+
+    g_signal_connect (
+            G_OBJECT (cache->priv->settings),
+            "notify::image-cache-size",
+            G_CALLBACK (cb_rstto_image_cache_size_changed),
+            cache);
+}
+
+
+static void
+rstto_image_cache_class_init (GObjectClass *object_class)
+{
+    RsttoImageCacheClass *cache_class = RSTTO_IMAGE_CACHE_CLASS (
+            object_class);
+
+    parent_class = g_type_class_peek_parent (cache_class);
+
+    object_class->dispose = rstto_image_cache_dispose;
+    object_class->finalize = rstto_image_cache_finalize;
+
+    rstto_image_cache_signals[RSTTO_IMAGE_CACHE_SIGNAL_READY] = g_signal_new("ready",
+            G_TYPE_FROM_CLASS(cache_class),
+            G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+            0,
+            NULL,
+            NULL,
+            g_cclosure_marshal_VOID__OBJECT,
+            G_TYPE_NONE,
+            1,
+            G_TYPE_OBJECT,
+            NULL);
+}
+
+static void
+rstto_image_cache_job_free (RsttoImageCacheJob *job)
+{
+    g_object_unref (job->key.file);
+    g_object_unref (job->cancellable);
+    g_object_unref (job->cache);
+    g_free (job);
+}
+
+/**
+ * rstto_image_cache_dispose:
+ * @object:
+ *
+ */
+static void
+rstto_image_cache_dispose (GObject *object)
+{
+    RsttoImageCache *cache = RSTTO_IMAGE_CACHE (object);
+
+    if (cache->priv)
+    {
+        /* Every job keeps a reference to the cache,
+         * none of them is pending at this point.
+         */
+        g_hash_table_destroy (cache->priv->jobs);
+        g_object_unref (cache->priv->decoder);
+
+        g_hash_table_destroy (cache->priv->entries);
+        g_queue_free (cache->priv->lru);
+
+        g_signal_handlers_disconnect_by_func (
+                cache->priv->settings,
+                cb_rstto_image_cache_size_changed,
+                cache);
+        g_object_unref (cache->priv->settings);
+
+        g_clear_pointer (&cache->priv, g_free);
+    }
+}
+
+/**
+ * rstto_image_cache_finalize:
+ * @object:
+ *
+ */
+static void
+rstto_image_cache_finalize (GObject *object)
+{
+}
+
+
+
+/**
+ * rstto_image_cache_new:
+ *
+ *
+ * Singleton
+ */
+RsttoImageCache *
+rstto_image_cache_new (void)
+{
+    if (image_cache_object == NULL)
+    {
+        image_cache_object = g_object_new (RSTTO_TYPE_IMAGE_CACHE, NULL);
+        g_object_add_weak_pointer (
+                G_OBJECT (image_cache_object),
+                (gpointer *) &image_cache_object);
+    }
+    else
+    {
+        g_object_ref (image_cache_object);
+    }
+
+    return image_cache_object;
+}
+
+/**
+ * rstto_image_cache_animation_size:
+ * @animation: A static image
+ *
+ * Return the number of bytes needed to keep @animation in memory.
+ */
+static gsize
+rstto_image_cache_animation_size (GdkPixbufAnimation *animation)
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_animation_get_static_image (animation);
+
+    return (gsize) gdk_pixbuf_get_rowstride (pixbuf) *
+           (gsize) gdk_pixbuf_get_height (pixbuf);
+}
+
+static void
+cb_rstto_image_cache_file_changed (
+        RsttoFile *r_file,
+        RsttoImageCacheEntry *entry)
+{
+    rstto_image_cache_remove_file (entry->cache, r_file);
+}
+
+static void
+rstto_image_cache_entry_free (RsttoImageCacheEntry *entry)
+{
+    RsttoImageCachePriv *priv = entry->cache->priv;
+
+    g_queue_delete_link (priv->lru, entry->link);
+    priv->size -= entry->size;
+
+    g_signal_handlers_disconnect_by_func (
+            entry->key.file,
+            cb_rstto_image_cache_file_changed,
+            entry);
+
+    g_object_unref (entry->key.file);
+    g_object_unref (entry->animation);
+    g_free (entry);
+}
+
+/**
+ * rstto_image_cache_evict:
+ * @cache:
+ *
+ * Drop the least recently used images until the cache
+ * fits in its budget again.
+ */
+static void
+rstto_image_cache_evict (RsttoImageCache *cache)
+{
+    RsttoImageCacheEntry *entry;
+
+    while (cache->priv->size > cache->priv->budget)
+    {
+        entry = g_queue_peek_tail (cache->priv->lru);
+        if (NULL == entry)
+        {
+            break;
+        }
+        g_hash_table_remove (cache->priv->entries, entry);
+    }
+}
+
+/**
+ * rstto_image_cache_lookup:
+ * @cache:
+ * @file:
+ * @max_width: Width the image was limited to when decoding, 0 for none
+ * @max_height: Height the image was limited to when decoding, 0 for none
+ * @orientation:
+ * @image_width: (out): Width of the image on disk
+ * @image_height: (out): Height of the image on disk
+ * @image_scale: (out): Scale at which the image was decoded
+ * @image_orientation: (out): Orientation to show the image in
+ *
+ * Return value: A new reference to the decoded image,
+ *               or NULL if it is not in the cache.
+ */
+GdkPixbufAnimation *
+rstto_image_cache_lookup (
+        RsttoImageCache *cache,
+        RsttoFile *file,
+        gint max_width,
+        gint max_height,
+        RsttoImageOrientation orientation,
+        gint *image_width,
+        gint *image_height,
+        gdouble *image_scale,
+        RsttoImageOrientation *image_orientation)
+{
+    RsttoImageCacheKey    key = { file, max_width, max_height, orientation };
+    RsttoImageCacheEntry *entry;
+
+    g_return_val_if_fail (RSTTO_IS_IMAGE_CACHE (cache), NULL);
+
+    entry = g_hash_table_lookup (cache->priv->entries, &key);
+    if (NULL == entry)
+    {
+        return NULL;
+    }
+
+    /* Move it to the front of the lru-queue */
+    g_queue_unlink (cache->priv->lru, entry->link);
+    g_queue_push_head_link (cache->priv->lru, entry->link);
+
+    *image_width = entry->image_width;
+    *image_height = entry->image_height;
+    *image_scale = entry->image_scale;
+    *image_orientation = entry->image_orientation;
+
+    return g_object_ref (entry->animation);
+}
+
+/**
+ * rstto_image_cache_insert:
+ * @cache:
+ * @file:
+ * @max_width:
+ * @max_height:
+ * @orientation: The orientation of the file it was decoded for
+ * @animation:
+ * @image_width:
+ * @image_height:
+ * @image_scale:
+ * @image_orientation: The orientation reported by the decoder
+ *
+ * Store a decoded image, images that do not fit in the
+ * budget by themselves are not stored. Neither are animations,
+ * their frames are not exposed, so their size is not known.
+ */
+void
+rstto_image_cache_insert (
+        RsttoImageCache *cache,
+        RsttoFile *file,
+        gint max_width,
+        gint max_height,
+        RsttoImageOrientation orientation,
+        GdkPixbufAnimation *animation,
+        gint image_width,
+        gint image_height,
+        gdouble image_scale,
+        RsttoImageOrientation image_orientation)
+{
+    RsttoImageCacheKey    key = { file, max_width, max_height, orientation };
+    RsttoImageCacheEntry *entry;
+    gsize                 size;
+
+    g_return_if_fail (RSTTO_IS_IMAGE_CACHE (cache));
+    g_return_if_fail (RSTTO_IS_FILE (file));
+    g_return_if_fail (GDK_IS_PIXBUF_ANIMATION (animation));
+
+    g_hash_table_remove (cache->priv->entries, &key);
+
+    if (FALSE == gdk_pixbuf_animation_is_static_image (animation))
+    {
+        return;
+    }
+
+    size = rstto_image_cache_animation_size (animation);
+    if (size > cache->priv->budget)
+    {
+        return;
+    }
+
+    entry = g_new0 (RsttoImageCacheEntry, 1);
+    entry->key = key;
+    entry->cache = cache;
+    entry->animation = g_object_ref (animation);
+    entry->image_width = image_width;
+    entry->image_height = image_height;
+    entry->image_scale = image_scale;
+    entry->image_orientation = image_orientation;
+    entry->size = size;
+
+    g_object_ref (file);
+    g_signal_connect (
+            file,
+            "changed",
+            G_CALLBACK (cb_rstto_image_cache_file_changed),
+            entry);
+
+    g_queue_push_head (cache->priv->lru, entry);
+    entry->link = cache->priv->lru->head;
+    cache->priv->size += size;
+
+    g_hash_table_insert (cache->priv->entries, entry, entry);
+
+    rstto_image_cache_evict (cache);
+}
+
+static gboolean
+rstto_image_cache_entry_has_file (
+        gpointer key,
+        gpointer value,
+        gpointer user_data)
+{
+    RsttoImageCacheEntry *entry = value;
+
+    return entry->key.file == user_data;
+}
+
+/**
+ * rstto_image_cache_remove_file:
+ * @cache:
+ * @file:
+ *
+ * Drop all decoded images of @file, and cancel the
+ * prefetch-jobs for it.
+ */
+void
+rstto_image_cache_remove_file (
+        RsttoImageCache *cache,
+        RsttoFile *file)
+{
+    RsttoImageCacheJob *job;
+    GHashTableIter      iter;
+
+    g_return_if_fail (RSTTO_IS_IMAGE_CACHE (cache));
+
+    g_hash_table_foreach_remove (
+            cache->priv->entries,
+            rstto_image_cache_entry_has_file,
+            file);
+
+    g_hash_table_iter_init (&iter, cache->priv->jobs);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &job, NULL))
+    {
+        if (job->key.file == file)
+        {
+            g_cancellable_cancel (job->cancellable);
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+}
+
+/**
+ * rstto_image_cache_set_prefetch:
+ * @cache:
+ * @files: The files to decode ahead, most important first
+ * @max_width:
+ * @max_height:
+ *
+ * Decode @files in the background, the "ready" signal is emitted
+ * for each of them once it is in the cache. Files that were
+ * prefetched before, but are not in @files anymore, are cancelled.
+ */
+void
+rstto_image_cache_set_prefetch (
+        RsttoImageCache *cache,
+        GList *files,
+        gint max_width,
+        gint max_height)
+{
+    RsttoImageCacheKey    key;
+    RsttoImageCacheEntry *entry;
+    RsttoImageCacheJob   *job;
+    GHashTableIter        iter;
+    GList                *list;
+    RsttoFile            *file;
+
+    g_return_if_fail (RSTTO_IS_IMAGE_CACHE (cache));
+
+    cache->priv->generation++;
+
+    /* Walk the list backwards, so the most important image
+     * ends up at the front of the lru-queue.
+     */
+    for (list = g_list_last (files); NULL != list; list = g_list_previous (list))
+    {
+        file = list->data;
+
+        key.file = file;
+        key.max_width = max_width;
+        key.max_height = max_height;
+        key.orientation = rstto_file_get_orientation (file);
+
+        entry = g_hash_table_lookup (cache->priv->entries, &key);
+        if (NULL != entry)
+        {
+            g_queue_unlink (cache->priv->lru, entry->link);
+            g_queue_push_head_link (cache->priv->lru, entry->link);
+            continue;
+        }
+
+        job = g_hash_table_lookup (cache->priv->jobs, &key);
+        if (NULL != job)
+        {
+            job->generation = cache->priv->generation;
+        }
+    }
+
+    /* Cancel the jobs that are not wanted anymore */
+    g_hash_table_iter_init (&iter, cache->priv->jobs);
+    while (g_hash_table_iter_next (&iter, (gpointer *) &job, NULL))
+    {
+        if (job->generation != cache->priv->generation)
+        {
+            g_cancellable_cancel (job->cancellable);
+            g_hash_table_iter_remove (&iter);
+        }
+    }
+
+    /* Queue the new ones, in order of importance */
+    for (list = files; NULL != list; list = g_list_next (list))
+    {
+        file = list->data;
+
+        key.file = file;
+        key.max_width = max_width;
+        key.max_height = max_height;
+        key.orientation = rstto_file_get_orientation (file);
+
+        if (g_hash_table_contains (cache->priv->entries, &key) ||
+            g_hash_table_contains (cache->priv->jobs, &key))
+        {
+            continue;
+        }
+
+        job = g_new0 (RsttoImageCacheJob, 1);
+        job->key = key;
+        job->cache = g_object_ref (cache);
+        job->generation = cache->priv->generation;
+        job->cancellable = g_cancellable_new ();
+        g_object_ref (file);
+
+        g_hash_table_insert (cache->priv->jobs, job, job);
+
+        /* Images that are displayed go first */
+        rstto_image_decoder_decode_async (
+                cache->priv->decoder,
+                file,
+                max_width,
+                max_height,
+                G_PRIORITY_LOW,
+                job->cancellable,
+                NULL,
+                cb_rstto_image_cache_decode_ready,
+                job);
+    }
+}
+
+static void
+cb_rstto_image_cache_decode_ready (
+        GObject *source_object,
+        GAsyncResult *result,
+        gpointer user_data)
+{
+    RsttoImageCacheJob *job = user_data;
+    RsttoImageCache    *cache = job->cache;
+    GdkPixbufAnimation *animation;
+    gint                image_width, image_height;
+    gdouble             image_scale;
+    RsttoImageOrientation orientation = job->key.orientation;
+
+    animation = rstto_image_decoder_decode_finish (
+            RSTTO_IMAGE_DECODER (source_object),
+            result,
+            &image_width,
+            &image_height,
+            &image_scale,
+            &orientation,
+            NULL);
+
+    /* Cancelled jobs were already removed from the table */
+    if (g_hash_table_lookup (cache->priv->jobs, job) == job)
+    {
+        g_hash_table_remove (cache->priv->jobs, job);
+    }
+
+    if (NULL != animation)
+    {
+        if (FALSE == g_cancellable_is_cancelled (job->cancellable))
+        {
+            rstto_image_cache_insert (
+                    cache,
+                    job->key.file,
+                    job->key.max_width,
+                    job->key.max_height,
+                    job->key.orientation,
+                    animation,
+                    image_width,
+                    image_height,
+                    image_scale,
+                    orientation);
+
+            g_signal_emit (
+                    G_OBJECT (cache),
+                    rstto_image_cache_signals[RSTTO_IMAGE_CACHE_SIGNAL_READY],
+                    0,
+                    job->key.file,
+                    NULL);
+        }
+        g_object_unref (animation);
+    }
+
+    rstto_image_cache_job_free (job);
+}
+
+static void
+cb_rstto_image_cache_size_changed (
+        GObject *settings,
+        GParamSpec *pspec,
+        gpointer user_data)
+{
+    RsttoImageCache *cache = RSTTO_IMAGE_CACHE (user_data);
+    guint            cache_size = 0;
+
+    g_object_get (
+            settings,
+            "image-cache-size", &cache_size,
+            NULL);
+
+    cache->priv->budget = (gsize) cache_size * 1024 * 1024;
+
+    rstto_image_cache_evict (cache);
+}
@@ -0,0 +1,111 @@
+/*
+ *  Copyright (c) Stephan Arts 2006-2012 <stephan@xfce.org>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#ifndef __RISTRETTO_IMAGE_CACHE_H__
+#define __RISTRETTO_IMAGE_CACHE_H__
+
+#include <gtk/gtk.h>
+
+#include "file.h"
+
+G_BEGIN_DECLS
+
+#define RSTTO_TYPE_IMAGE_CACHE rstto_image_cache_get_type()
+
+#define RSTTO_IMAGE_CACHE(obj)( \
+        G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                RSTTO_TYPE_IMAGE_CACHE, \
+                RsttoImageCache))
+
+#define RSTTO_IS_IMAGE_CACHE(obj)( \
+        G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                RSTTO_TYPE_IMAGE_CACHE))
+
+#define RSTTO_IMAGE_CACHE_CLASS(klass)( \
+        G_TYPE_CHECK_CLASS_CAST ((klass), \
+                RSTTO_TYPE_IMAGE_CACHE, \
+                RsttoImageCacheClass))
+
+#define RSTTO_IS_IMAGE_CACHE_CLASS(klass)( \
+        G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                RSTTO_TYPE_IMAGE_CACHE()))
+
+typedef struct _RsttoImageCache RsttoImageCache;
+typedef struct _RsttoImageCachePriv RsttoImageCachePriv;
+
+struct _RsttoImageCache
+{
+    GObject parent;
+
+    RsttoImageCachePriv *priv;
+};
+
+typedef struct _RsttoImageCacheClass RsttoImageCacheClass;
+
+struct _RsttoImageCacheClass
+{
+    GObjectClass parent_class;
+};
+
+RsttoImageCache *
+rstto_image_cache_new (void);
+
+GType
+rstto_image_cache_get_type (void);
+
+GdkPixbufAnimation *
+rstto_image_cache_lookup (
+        RsttoImageCache *cache,
+        RsttoFile *file,
+        gint max_width,
+        gint max_height,
+        RsttoImageOrientation orientation,
+        gint *image_width,
+        gint *image_height,
+        gdouble *image_scale,
+        RsttoImageOrientation *image_orientation);
+
+void
+rstto_image_cache_insert (
+        RsttoImageCache *cache,
+        RsttoFile *file,
+        gint max_width,
+        gint max_height,
+        RsttoImageOrientation orientation,
+        GdkPixbufAnimation *animation,
+        gint image_width,
+        gint image_height,
+        gdouble image_scale,
+        RsttoImageOrientation image_orientation);
+
+void
+rstto_image_cache_remove_file (
+        RsttoImageCache *cache,
+        RsttoFile *file);
+
+void
+rstto_image_cache_set_prefetch (
+        RsttoImageCache *cache,
+        GList *files,
+        gint max_width,
+        gint max_height);
+
+G_END_DECLS
+
+#endif /* __RISTRETTO_IMAGE_CACHE_H__ */
@@ -0,0 +1,1360 @@
+/*
+ *  Copyright (c) Stephan Arts 2006-2012 <stephan@xfce.org>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#include <config.h>
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gtk/gtk.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include "util.h"
+#include "file.h"
+#include "image_decoder.h"
+
+/* Maximum number of threads decoding images */
+#ifndef RSTTO_IMAGE_DECODER_MAX_THREADS
+#define RSTTO_IMAGE_DECODER_MAX_THREADS 4
+#endif
+
+/* Images with more pixels than this are decoded at a reduced
+ * size, the pixbuf of a gigapixel scan does not fit in memory.
+ * It is well above the 100 Mpx of medium-format cameras, so
+ * their photos can still be viewed at 100%.
+ */
+#ifndef RSTTO_IMAGE_DECODER_MAX_PIXELS
+#define RSTTO_IMAGE_DECODER_MAX_PIXELS (112 * 1024 * 1024)
+#endif
+
+/* Do not make this buffer too large,
+ * this breaks some pixbufloaders.
+ */
+#ifndef RSTTO_IMAGE_DECODER_BUFFER_SIZE
+#define RSTTO_IMAGE_DECODER_BUFFER_SIZE 4096
+#endif
+
+/* Local files are mapped into memory, and handed
+ * to the loader in slices of this size.
+ */
+#ifndef RSTTO_IMAGE_DECODER_SLICE_SIZE
+#define RSTTO_IMAGE_DECODER_SLICE_SIZE (1024 * 1024)
+#endif
+
+/* Files modified less than this number of seconds ago may still
+ * be written to, these are read instead of mapped into memory.
+ */
+#ifndef RSTTO_IMAGE_DECODER_SETTLE_TIME
+#define RSTTO_IMAGE_DECODER_SETTLE_TIME 5
+#endif
+
+/* Loaders that parse their headers per write, and
+ * misbehave when a single write spans several of them.
+ * These are fed in RSTTO_IMAGE_DECODER_BUFFER_SIZE chunks.
+ */
+static const gchar *rstto_image_decoder_small_writes[] =
+{
+    "application/x-navi-animation",
+    "image/x-icon",
+    "image/vnd.microsoft.icon",
+    "image/x-tga",
+    NULL
+};
+
+/* Camera raw formats that are TIFF-containers, with a
+ * full-size JPEG preview in one of their IFDs.
+ */
+static const gchar *rstto_image_decoder_raw_types[] =
+{
+    "image/x-adobe-dng",
+    "image/x-canon-cr2",
+    "image/x-nikon-nef",
+    "image/x-nikon-nrw",
+    "image/x-pentax-pef",
+    "image/x-samsung-srw",
+    "image/x-sony-arw",
+    "image/x-sony-sr2",
+    NULL
+};
+
+/* Number of IFDs that are read from a raw file,
+ * guards against loops in broken files.
+ */
+#ifndef RSTTO_IMAGE_DECODER_RAW_MAX_IFDS
+#define RSTTO_IMAGE_DECODER_RAW_MAX_IFDS 32
+#endif
+
+static void
+rstto_image_decoder_init (GObject *);
+static void
+rstto_image_decoder_class_init (GObjectClass *);
+
+static void
+rstto_image_decoder_dispose (GObject *object);
+static void
+rstto_image_decoder_finalize (GObject *object);
+
+static void
+rstto_image_decoder_thread (
+        gpointer data,
+        gpointer user_data);
+static gint
+rstto_image_decoder_compare_tasks (
+        gconstpointer a,
+        gconstpointer b,
+        gpointer user_data);
+
+static GObjectClass *parent_class = NULL;
+
+static RsttoImageDecoder *image_decoder_object;
+
+GType
+rstto_image_decoder_get_type (void)
+{
+    static GType rstto_image_decoder_type = 0;
+
+    if (!rstto_image_decoder_type)
+    {
+        static const GTypeInfo rstto_image_decoder_info = 
+        {
+            sizeof (RsttoImageDecoderClass),
+            (GBaseInitFunc) NULL,
+            (GBaseFinalizeFunc) NULL,
+            (GClassInitFunc) rstto_image_decoder_class_init,
+            (GClassFinalizeFunc) NULL,
+            NULL,
+            sizeof (RsttoImageDecoder),
+            0,
+            (GInstanceInitFunc) rstto_image_decoder_init,
+            NULL
+        };
+
+        rstto_image_decoder_type = g_type_register_static (
+                G_TYPE_OBJECT,
+                "RsttoImageDecoder",
+                &rstto_image_decoder_info,
+                0);
+    }
+    return rstto_image_decoder_type;
+}
+
+struct _RsttoImageDecoderPriv
+{
+    /* Runs the GTasks, the one with the highest priority first */
+    GThreadPool *pool;
+};
+
+typedef struct _RsttoImageDecoderJob RsttoImageDecoderJob;
+
+struct _RsttoImageDecoderJob
+{
+    GFile   *g_file;
+    gchar   *content_type;
+    /* Set if the content-type still has to be sniffed */
+    gchar   *path;
+    gint     max_width;
+    gint     max_height;
+
+    /* Orientation to show the image in, set to NONE by the
+     * worker-thread if it turns the image upright itself.
+     */
+    RsttoImageOrientation orientation;
+    gboolean              default_orientation;
+
+    /* Filled in by the worker-thread */
+    gint     image_width;
+    gint     image_height;
+    gdouble  image_scale;
+
+    /* Progress is reported to the main-loop with an idle-source,
+     * there is never more than one pending.
+     */
+    RsttoImageDecoderProgressFunc progress_func;
+    gpointer                      progress_data;
+    GdkPixbuf                    *progress_pixbuf;
+    gint                          progress_pending;
+
+    /* Part of the pixbuf that was updated since the last report */
+    GMutex                        progress_lock;
+    GdkRectangle                  progress_area;
+
+    /* Set before the task returns, after that the
+     * progress_data is no longer valid.
+     */
+    gint                          done;
+};
+
+static void
+rstto_image_decoder_init (GObject *object)
+{
+    RsttoImageDecoder *decoder = RSTTO_IMAGE_DECODER (object);
+
+    decoder->priv = g_new0 (RsttoImageDecoderPriv, 1);
+    decoder->priv->pool = g_thread_pool_new (
+            rstto_image_decoder_thread,
+            decoder,
+            MIN (RSTTO_IMAGE_DECODER_MAX_THREADS, (gint) g_get_num_processors ()),
+            FALSE,
+            NULL);
+    g_thread_pool_set_sort_function (
+            decoder->priv->pool,
+            rstto_image_decoder_compare_tasks,
+            NULL);
+}
+
+
+static void
+rstto_image_decoder_class_init (GObjectClass *object_class)
+{
+    RsttoImageDecoderClass *decoder_class = RSTTO_IMAGE_DECODER_CLASS (
+            object_class);
+
+    parent_class = g_type_class_peek_parent (decoder_class);
+
+    object_class->dispose = rstto_image_decoder_dispose;
+    object_class->finalize = rstto_image_decoder_finalize;
+}
+
+/**
+ * rstto_image_decoder_dispose:
+ * @object:
+ *
+ */
+static void
+rstto_image_decoder_dispose (GObject *object)
+{
+    RsttoImageDecoder *decoder = RSTTO_IMAGE_DECODER (object);
+
+    if (decoder->priv)
+    {
+        /* Every task keeps a reference to the decoder,
+         * there is nothing left in the pool at this point.
+         */
+        g_thread_pool_free (decoder->priv->pool, FALSE, TRUE);
+
+        g_clear_pointer (&decoder->priv, g_free);
+    }
+}
+
+/**
+ * rstto_image_decoder_finalize:
+ * @object:
+ *
+ */
+static void
+rstto_image_decoder_finalize (GObject *object)
+{
+}
+
+
+
+/**
+ * rstto_image_decoder_new:
+ *
+ *
+ * Singleton
+ */
+RsttoImageDecoder *
+rstto_image_decoder_new (void)
+{
+    if (image_decoder_object == NULL)
+    {
+        image_decoder_object = g_object_new (RSTTO_TYPE_IMAGE_DECODER, NULL);
+        g_object_add_weak_pointer (
+                G_OBJECT (image_decoder_object),
+                (gpointer *) &image_decoder_object);
+    }
+    else
+    {
+        g_object_ref (image_decoder_object);
+    }
+
+    return image_decoder_object;
+}
+
+static void
+rstto_image_decoder_job_free (RsttoImageDecoderJob *job)
+{
+    g_object_unref (job->g_file);
+    g_free (job->content_type);
+    g_free (job->path);
+    if (NULL != job->progress_pixbuf)
+    {
+        g_object_unref (job->progress_pixbuf);
+    }
+    g_mutex_clear (&job->progress_lock);
+    g_free (job);
+}
+
+static gint
+rstto_image_decoder_compare_tasks (
+        gconstpointer a,
+        gconstpointer b,
+        gpointer user_data)
+{
+    gint priority_a = g_task_get_priority (G_TASK (a));
+    gint priority_b = g_task_get_priority (G_TASK (b));
+
+    return (priority_a > priority_b) - (priority_a < priority_b);
+}
+
+/**
+ * rstto_image_decoder_decode_async:
+ * @decoder:
+ * @file:
+ * @max_width: Width to limit the image to, 0 for no limit
+ * @max_height: Height to limit the image to, 0 for no limit
+ * @priority: Tasks with a lower value are decoded first
+ * @cancellable:
+ * @progress_func: (nullable): Called in the main-loop when more of the image is decoded
+ * @callback: Called in the main-loop when the image is decoded
+ * @user_data: Passed to @progress_func and @callback
+ *
+ * Decode @file in a worker-thread.
+ */
+void
+rstto_image_decoder_decode_async (
+        RsttoImageDecoder *decoder,
+        RsttoFile *file,
+        gint max_width,
+        gint max_height,
+        gint priority,
+        GCancellable *cancellable,
+        RsttoImageDecoderProgressFunc progress_func,
+        GAsyncReadyCallback callback,
+        gpointer user_data)
+{
+    RsttoImageDecoderJob *job;
+    GTask                *task;
+
+    g_return_if_fail (RSTTO_IS_IMAGE_DECODER (decoder));
+    g_return_if_fail (RSTTO_IS_FILE (file));
+
+    job = g_new0 (RsttoImageDecoderJob, 1);
+    job->g_file = g_object_ref (rstto_file_get_file (file));
+    /* Sniffing reads the file, leave that to the worker-thread */
+    job->content_type = g_strdup (rstto_file_get_known_content_type (file));
+    if (FALSE == rstto_file_has_content_type (file))
+    {
+        job->path = g_strdup (rstto_file_get_path (file));
+    }
+    job->max_width = max_width;
+    job->max_height = max_height;
+    job->orientation = rstto_file_get_orientation (file);
+    job->default_orientation = rstto_file_has_default_orientation (file);
+    job->image_scale = 1.0;
+    job->progress_func = progress_func;
+    job->progress_data = user_data;
+    g_mutex_init (&job->progress_lock);
+
+    task = g_task_new (decoder, cancellable, callback, user_data);
+    g_task_set_source_tag (task, rstto_image_decoder_decode_async);
+    g_task_set_priority (task, priority);
+    g_task_set_task_data (task, job, (GDestroyNotify) rstto_image_decoder_job_free);
+
+    g_thread_pool_push (decoder->priv->pool, task, NULL);
+}
+
+/**
+ * rstto_image_decoder_decode_finish:
+ * @decoder:
+ * @result:
+ * @image_width: (out): Width of the image on disk
+ * @image_height: (out): Height of the image on disk
+ * @image_scale: (out): Scale at which the image was decoded
+ * @orientation: (out): Orientation to show the image in, this is
+ *               RSTTO_IMAGE_ORIENT_NONE if the decoder turned it upright
+ * @error:
+ *
+ * Return value: The decoded image, or NULL on error.
+ */
+GdkPixbufAnimation *
+rstto_image_decoder_decode_finish (
+        RsttoImageDecoder *decoder,
+        GAsyncResult *result,
+        gint *image_width,
+        gint *image_height,
+        gdouble *image_scale,
+        RsttoImageOrientation *orientation,
+        GError **error)
+{
+    RsttoImageDecoderJob *job;
+    GdkPixbufAnimation   *animation;
+
+    g_return_val_if_fail (g_task_is_valid (result, decoder), NULL);
+
+    animation = g_task_propagate_pointer (G_TASK (result), error);
+    if (NULL != animation)
+    {
+        job = g_task_get_task_data (G_TASK (result));
+        *image_width = job->image_width;
+        *image_height = job->image_height;
+        *image_scale = job->image_scale;
+        *orientation = job->orientation;
+    }
+
+    return animation;
+}
+
+static void
+cb_rstto_image_decoder_size_prepared (
+        GdkPixbufLoader *loader,
+        gint width,
+        gint height,
+        RsttoImageDecoderJob *job)
+{
+    gint max_width = job->max_width;
+    gint max_height = job->max_height;
+
+    /*
+     * By default, the image-size won't be limited to screen-size (since it's smaller)
+     * or, because we don't want to reduce it.
+     * Set the image_scale to 1.0 (100%)
+     */
+    job->image_scale = 1.0;
+
+    job->image_width = width;
+    job->image_height = height;
+
+    if (max_width > 0 && max_height > 0 &&
+        (max_width < width || max_height < height))
+    {
+        /*
+         * The image is loaded at the screen_size, calculate how this fits best.
+         *  scale = MIN(width / screen_width, height / screen_height)
+         *
+         */
+        if (((gdouble)width / (gdouble)max_width) < ((gdouble)height / (gdouble)max_height))
+        {
+            job->image_scale = (gdouble)max_width / (gdouble)width;
+            gdk_pixbuf_loader_set_size (loader,
+                                        max_width,
+                                        (gint)((gdouble)height/(gdouble)width*(gdouble)max_width));
+        }
+        else
+        {
+            job->image_scale = (gdouble)max_height / (gdouble)height;
+            gdk_pixbuf_loader_set_size (loader,
+                                        (gint)((gdouble)width/(gdouble)height*(gdouble)max_height),
+                                        max_height);
+        }
+    }
+
+    /* Whatever size is left, it still has to fit in memory */
+    if ((gdouble)width * (gdouble)height * job->image_scale * job->image_scale >
+        (gdouble)RSTTO_IMAGE_DECODER_MAX_PIXELS)
+    {
+        job->image_scale = sqrt ((gdouble)RSTTO_IMAGE_DECODER_MAX_PIXELS /
+                                 ((gdouble)width * (gdouble)height));
+        gdk_pixbuf_loader_set_size (loader,
+                                    MAX (1, (gint)((gdouble)width * job->image_scale)),
+                                    MAX (1, (gint)((gdouble)height * job->image_scale)));
+    }
+}
+
+static gboolean
+cb_rstto_image_decoder_progress (gpointer user_data)
+{
+    GTask                *task = user_data;
+    RsttoImageDecoderJob *job = g_task_get_task_data (task);
+    GdkRectangle          area;
+
+    g_mutex_lock (&job->progress_lock);
+    g_atomic_int_set (&job->progress_pending, FALSE);
+    area = job->progress_area;
+    job->progress_area.width = 0;
+    job->progress_area.height = 0;
+    g_mutex_unlock (&job->progress_lock);
+
+    /* Once the task has returned, its callback may
+     * already have released the progress_data.
+     */
+    if (FALSE == g_atomic_int_get (&job->done) &&
+        FALSE == g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+    {
+        job->progress_func (
+                g_task_get_source_object (task),
+                job->progress_pixbuf,
+                &area,
+                job->image_width,
+                job->image_height,
+                job->image_scale,
+                job->progress_data);
+    }
+
+    return FALSE;
+}
+
+/**
+ * rstto_image_decoder_report_progress:
+ * @task:
+ *
+ * Schedule a progress-report in the main-loop, unless
+ * one is already pending. Runs in the worker-thread.
+ */
+static void
+rstto_image_decoder_report_progress (GTask *task)
+{
+    RsttoImageDecoderJob *job = g_task_get_task_data (task);
+
+    if (NULL != job->progress_pixbuf &&
+        g_atomic_int_compare_and_exchange (&job->progress_pending, FALSE, TRUE))
+    {
+        g_main_context_invoke_full (
+                g_task_get_context (task),
+                G_PRIORITY_DEFAULT_IDLE,
+                cb_rstto_image_decoder_progress,
+                g_object_ref (task),
+                g_object_unref);
+    }
+}
+
+static void
+cb_rstto_image_decoder_area_prepared (
+        GdkPixbufLoader *loader,
+        GTask *task)
+{
+    RsttoImageDecoderJob *job = g_task_get_task_data (task);
+
+    /* The loader decodes into this pixbuf, and keeps it when it is done */
+    job->progress_pixbuf = g_object_ref (gdk_pixbuf_loader_get_pixbuf (loader));
+
+    rstto_image_decoder_report_progress (task);
+}
+
+static void
+cb_rstto_image_decoder_area_updated (
+        GdkPixbufLoader *loader,
+        gint x,
+        gint y,
+        gint width,
+        gint height,
+        GTask *task)
+{
+    RsttoImageDecoderJob *job = g_task_get_task_data (task);
+    GdkRectangle          rect = { x, y, width, height };
+
+    g_mutex_lock (&job->progress_lock);
+    if (0 == job->progress_area.width || 0 == job->progress_area.height)
+    {
+        job->progress_area = rect;
+    }
+    else
+    {
+        gdk_rectangle_union (&job->progress_area, &rect, &job->progress_area);
+    }
+    g_mutex_unlock (&job->progress_lock);
+
+    rstto_image_decoder_report_progress (task);
+}
+
+/**
+ * rstto_image_decoder_get_slice_size:
+ * @content_type:
+ *
+ * Return value: The number of bytes to write to the loader at once,
+ *               for a file that is mapped into memory.
+ */
+static gsize
+rstto_image_decoder_get_slice_size (const gchar *content_type)
+{
+    gint i;
+
+    if (NULL != content_type)
+    {
+        for (i = 0; NULL != rstto_image_decoder_small_writes[i]; ++i)
+        {
+            if (0 == g_strcmp0 (content_type, rstto_image_decoder_small_writes[i]))
+            {
+                return RSTTO_IMAGE_DECODER_BUFFER_SIZE;
+            }
+        }
+    }
+
+    return RSTTO_IMAGE_DECODER_SLICE_SIZE;
+}
+
+/**
+ * rstto_image_decoder_map_file:
+ * @g_file:
+ * @fd: (out): The descriptor the file was mapped from, or -1
+ *
+ * Accessing a part of a mapped file that was truncated kills the
+ * process with SIGBUS. Files that were modified just now are not
+ * mapped, and @fd is kept open to check the size of the file
+ * before each part of it is read.
+ *
+ * Return value: The file mapped into memory, or NULL if the
+ *               file is not local or can not be mapped.
+ */
+static GMappedFile *
+rstto_image_decoder_map_file (GFile *g_file, gint *fd)
+{
+    GMappedFile *mapped = NULL;
+    gchar       *path;
+    struct stat  st;
+
+    *fd = -1;
+
+    /* GVfs-files are streamed */
+    if (FALSE == g_file_is_native (g_file))
+    {
+        return NULL;
+    }
+
+    path = g_file_get_path (g_file);
+    if (NULL != path)
+    {
+        *fd = g_open (path, O_RDONLY, 0);
+        g_free (path);
+    }
+
+    if (-1 == *fd)
+    {
+        return NULL;
+    }
+
+    /* Empty files and files that may still be written
+     * are not mapped, leave those to the stream.
+     */
+    if (0 == fstat (*fd, &st) &&
+        0 < st.st_size &&
+        (gint64) st.st_mtime + RSTTO_IMAGE_DECODER_SETTLE_TIME <=
+                g_get_real_time () / G_USEC_PER_SEC)
+    {
+        mapped = g_mapped_file_new_from_fd (*fd, FALSE, NULL);
+    }
+
+    if (NULL == mapped)
+    {
+        close (*fd);
+        *fd = -1;
+    }
+
+    return mapped;
+}
+
+/**
+ * rstto_image_decoder_check_mapped:
+ * @fd: The descriptor the file was mapped from
+ * @end: The offset up to which the mapping is read
+ * @error:
+ *
+ * Return value: FALSE if the file was truncated before @end.
+ */
+static gboolean
+rstto_image_decoder_check_mapped (
+        gint fd,
+        gsize end,
+        GError **error)
+{
+    struct stat st;
+
+    if (0 != fstat (fd, &st) || (guint64) st.st_size < (guint64) end)
+    {
+        g_set_error_literal (
+                error,
+                G_IO_ERROR,
+                G_IO_ERROR_FAILED,
+                _("The file was truncated while it was loaded"));
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * rstto_image_decoder_write_mapped:
+ * @job:
+ * @loader:
+ * @mapped:
+ * @fd: The descriptor @mapped was mapped from
+ * @start: Offset of the part of @mapped to write
+ * @length:
+ * @cancellable:
+ * @error:
+ *
+ * Hand part of @mapped to @loader, without copying it.
+ */
+static gboolean
+rstto_image_decoder_write_mapped (
+        RsttoImageDecoderJob *job,
+        GdkPixbufLoader *loader,
+        GMappedFile *mapped,
+        gint fd,
+        gsize start,
+        gsize length,
+        GCancellable *cancellable,
+        GError **error)
+{
+    const guchar *contents = (const guchar *) g_mapped_file_get_contents (mapped) + start;
+    gsize         slice_size = rstto_image_decoder_get_slice_size (job->content_type);
+    gsize         slice;
+    gsize         offset;
+
+#if HAVE_SYS_MMAN_H && HAVE_POSIX_MADVISE
+    {
+        /* The advice has to start at a page-boundary */
+        gsize page_size = (gsize) sysconf (_SC_PAGESIZE);
+        gsize skip = (gsize) contents % page_size;
+
+        /* The loaders read the data front to back, exactly once */
+        posix_madvise ((void *) (contents - skip), length + skip, POSIX_MADV_SEQUENTIAL);
+        posix_madvise ((void *) (contents - skip), length + skip, POSIX_MADV_WILLNEED);
+    }
+#endif
+
+    for (offset = 0; offset < length; offset += slice_size)
+    {
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        {
+            return FALSE;
+        }
+
+        slice = MIN (slice_size, length - offset);
+
+        if (FALSE == rstto_image_decoder_check_mapped (fd, start + offset + slice, error))
+        {
+            return FALSE;
+        }
+
+        if (FALSE == gdk_pixbuf_loader_write (
+                loader,
+                contents + offset,
+                slice,
+                error))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * rstto_image_decoder_write_stream:
+ * @job:
+ * @loader:
+ * @cancellable:
+ * @error:
+ *
+ * Read the file in small chunks, and hand them to @loader.
+ */
+static gboolean
+rstto_image_decoder_write_stream (
+        RsttoImageDecoderJob *job,
+        GdkPixbufLoader *loader,
+        GCancellable *cancellable,
+        GError **error)
+{
+    GFileInputStream *stream;
+    guchar            buffer[RSTTO_IMAGE_DECODER_BUFFER_SIZE];
+    gssize            n_read;
+    gboolean          ret_val = TRUE;
+
+    stream = g_file_read (job->g_file, cancellable, error);
+    if (NULL == stream)
+    {
+        return FALSE;
+    }
+
+    do
+    {
+        n_read = g_input_stream_read (
+                G_INPUT_STREAM (stream),
+                buffer,
+                RSTTO_IMAGE_DECODER_BUFFER_SIZE,
+                cancellable,
+                error);
+        if (n_read < 0 ||
+            (n_read > 0 && FALSE == gdk_pixbuf_loader_write (loader, buffer, n_read, error)))
+        {
+            ret_val = FALSE;
+        }
+    } while (n_read > 0 && TRUE == ret_val);
+
+    g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+    g_object_unref (stream);
+
+    return ret_val;
+}
+
+typedef struct
+{
+    const guchar *data;
+    gsize         length;
+    gboolean      big_endian;
+    gint          n_ifds;
+
+    /* Orientation-tag of IFD0, 0 if it is missing */
+    gint          orientation;
+
+    /* The largest preview that was found */
+    gsize         offset;
+    gsize         size;
+    guint64       pixels;
+} RsttoRawPreview;
+
+static guint32
+rstto_raw_preview_get_16 (RsttoRawPreview *raw, gsize offset)
+{
+    const guchar *p = raw->data + offset;
+
+    if (raw->big_endian)
+    {
+        return ((guint32) p[0] << 8) | p[1];
+    }
+    return ((guint32) p[1] << 8) | p[0];
+}
+
+static guint32
+rstto_raw_preview_get_32 (RsttoRawPreview *raw, gsize offset)
+{
+    const guchar *p = raw->data + offset;
+
+    if (raw->big_endian)
+    {
+        return ((guint32) p[0] << 24) | ((guint32) p[1] << 16) | ((guint32) p[2] << 8) | p[3];
+    }
+    return ((guint32) p[3] << 24) | ((guint32) p[2] << 16) | ((guint32) p[1] << 8) | p[0];
+}
+
+/* The value of a SHORT or LONG IFD-entry with a count of 1 */
+static guint32
+rstto_raw_preview_get_value (RsttoRawPreview *raw, gsize entry)
+{
+    if (3 == rstto_raw_preview_get_16 (raw, entry + 2))
+    {
+        return rstto_raw_preview_get_16 (raw, entry + 8);
+    }
+    return rstto_raw_preview_get_32 (raw, entry + 8);
+}
+
+/**
+ * rstto_raw_preview_get_jpeg_pixels:
+ * @raw:
+ * @offset:
+ * @size:
+ *
+ * Return value: The number of pixels of the JPEG at @offset, or 0 if it is not
+ *               a JPEG that gdk-pixbuf can decode. Raw files store the sensor
+ *               data as lossless JPEG, which looks the same up to the frame header.
+ */
+static guint64
+rstto_raw_preview_get_jpeg_pixels (RsttoRawPreview *raw, gsize offset, gsize size)
+{
+    const guchar *p = raw->data + offset;
+    gsize         i = 2;
+
+    if (size < 4 || 0xFF != p[0] || 0xD8 != p[1])
+    {
+        return 0;
+    }
+
+    /* Marker, segment-length, precision, height and width */
+    while (i + 9 <= size)
+    {
+        if (0xFF != p[i])
+        {
+            return 0;
+        }
+
+        switch (p[i + 1])
+        {
+            case 0xFF:
+                /* Fill-byte */
+                ++i;
+                continue;
+            case 0xC0:
+            case 0xC1:
+            case 0xC2:
+                /* Baseline, extended and progressive frames */
+                return (guint64) (((guint32) p[i + 5] << 8) | p[i + 6]) *
+                       (guint64) (((guint32) p[i + 7] << 8) | p[i + 8]);
+            case 0xDA:
+            case 0xD9:
+                return 0;
+            default:
+                if (p[i + 1] >= 0xC3 && p[i + 1] <= 0xCF &&
+                    0xC4 != p[i + 1] && 0xC8 != p[i + 1] && 0xCC != p[i + 1])
+                {
+                    /* Lossless, arithmetic or hierarchical frames */
+                    return 0;
+                }
+                break;
+        }
+
+        i += 2 + (((gsize) p[i + 2] << 8) | p[i + 3]);
+    }
+
+    return 0;
+}
+
+static void
+rstto_raw_preview_add_candidate (RsttoRawPreview *raw, guint32 offset, guint32 size)
+{
+    guint64 pixels;
+
+    if (0 == offset || 0 == size || offset >= raw->length || size > raw->length - offset)
+    {
+        return;
+    }
+
+    pixels = rstto_raw_preview_get_jpeg_pixels (raw, offset, size);
+    if (pixels > raw->pixels)
+    {
+        raw->offset = offset;
+        raw->size = size;
+        raw->pixels = pixels;
+    }
+}
+
+/**
+ * rstto_raw_preview_read_ifds:
+ * @raw:
+ * @offset: Offset of the first IFD in the chain
+ * @first: TRUE if the chain starts at IFD0
+ *
+ * Look for JPEG-previews in a chain of IFDs, and in their SubIFDs.
+ */
+static void
+rstto_raw_preview_read_ifds (RsttoRawPreview *raw, guint32 offset, gboolean first)
+{
+    guint32 n_entries, i, j;
+    guint32 count, array;
+    guint32 compression, strip_offset, strip_size, jpeg_offset, jpeg_size;
+    gsize   entry;
+
+    while (0 != offset && raw->n_ifds < RSTTO_IMAGE_DECODER_RAW_MAX_IFDS)
+    {
+        ++raw->n_ifds;
+
+        if (offset > raw->length - 2)
+        {
+            return;
+        }
+
+        /* The entries and the offset of the next IFD */
+        n_entries = rstto_raw_preview_get_16 (raw, offset);
+        if ((gsize) n_entries * 12 + 6 > raw->length - offset)
+        {
+            return;
+        }
+
+        compression = strip_offset = strip_size = jpeg_offset = jpeg_size = 0;
+
+        for (i = 0; i < n_entries; ++i)
+        {
+            entry = offset + 2 + i * 12;
+            count = rstto_raw_preview_get_32 (raw, entry + 4);
+
+            switch (rstto_raw_preview_get_16 (raw, entry))
+            {
+                case 0x0103: /* Compression */
+                    compression = rstto_raw_preview_get_value (raw, entry);
+                    break;
+                case 0x0111: /* StripOffsets */
+                    strip_offset = (1 == count) ? rstto_raw_preview_get_value (raw, entry) : 0;
+                    break;
+                case 0x0117: /* StripByteCounts */
+                    strip_size = (1 == count) ? rstto_raw_preview_get_value (raw, entry) : 0;
+                    break;
+                case 0x0201: /* JPEGInterchangeFormat */
+                    jpeg_offset = rstto_raw_preview_get_32 (raw, entry + 8);
+                    break;
+                case 0x0202: /* JPEGInterchangeFormatLength */
+                    jpeg_size = rstto_raw_preview_get_32 (raw, entry + 8);
+                    break;
+                case 0x0112: /* Orientation */
+                    if (first)
+                    {
+                        raw->orientation = rstto_raw_preview_get_16 (raw, entry + 8);
+                    }
+                    break;
+                case 0x014A: /* SubIFDs */
+                    if (1 == count)
+                    {
+                        rstto_raw_preview_read_ifds (raw, rstto_raw_preview_get_32 (raw, entry + 8), FALSE);
+                    }
+                    else
+                    {
+                        array = rstto_raw_preview_get_32 (raw, entry + 8);
+                        if (array < raw->length && (gsize) count * 4 <= raw->length - array)
+                        {
+                            for (j = 0; j < count; ++j)
+                            {
+                                rstto_raw_preview_read_ifds (
+                                        raw,
+                                        rstto_raw_preview_get_32 (raw, array + j * 4),
+                                        FALSE);
+                            }
+                        }
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        /* Old-style and new-style JPEG compression */
+        if (6 == compression || 7 == compression)
+        {
+            rstto_raw_preview_add_candidate (raw, strip_offset, strip_size);
+        }
+        rstto_raw_preview_add_candidate (raw, jpeg_offset, jpeg_size);
+
+        offset = rstto_raw_preview_get_32 (raw, offset + 2 + n_entries * 12);
+        first = FALSE;
+    }
+}
+
+/**
+ * rstto_image_decoder_find_raw_preview:
+ * @content_type:
+ * @data: Contents of the file
+ * @length:
+ * @offset: (out): Offset of the largest JPEG-preview
+ * @size: (out): Size of the largest JPEG-preview
+ * @orientation: (out): The orientation of the image, 0 if unknown
+ *
+ * Return value: TRUE if @data is a camera raw file with a JPEG-preview.
+ */
+static gboolean
+rstto_image_decoder_find_raw_preview (
+        const gchar *content_type,
+        const guchar *data,
+        gsize length,
+        gsize *offset,
+        gsize *size,
+        gint *orientation)
+{
+    RsttoRawPreview raw = { 0 };
+    gboolean        is_raw = FALSE;
+    gint            i;
+
+    if (NULL == content_type)
+    {
+        return FALSE;
+    }
+
+    for (i = 0; NULL != rstto_image_decoder_raw_types[i]; ++i)
+    {
+        if (0 == g_strcmp0 (content_type, rstto_image_decoder_raw_types[i]))
+        {
+            is_raw = TRUE;
+            break;
+        }
+    }
+
+    if (FALSE == is_raw || length < 8)
+    {
+        return FALSE;
+    }
+
+    if (0 == memcmp (data, "II*\0", 4))
+    {
+        raw.big_endian = FALSE;
+    }
+    else if (0 == memcmp (data, "MM\0*", 4))
+    {
+        raw.big_endian = TRUE;
+    }
+    else
+    {
+        return FALSE;
+    }
+
+    raw.data = data;
+    raw.length = length;
+    rstto_raw_preview_read_ifds (&raw, rstto_raw_preview_get_32 (&raw, 4), TRUE);
+
+    if (0 == raw.pixels)
+    {
+        return FALSE;
+    }
+
+    *offset = raw.offset;
+    *size = raw.size;
+    *orientation = raw.orientation;
+
+    return TRUE;
+}
+
+/**
+ * rstto_image_decoder_apply_orientation:
+ * @job:
+ * @animation: (transfer full): A decoded raw-preview
+ * @orientation: The orientation from the raw file
+ *
+ * The preview is always turned upright. The orientation of the job
+ * is reset if it is the one stored in the file, it should not be
+ * applied to the upright preview again. An orientation the user
+ * picked is relative to the upright preview, it is kept.
+ *
+ * Return value: (transfer full): @animation, turned upright.
+ */
+static GdkPixbufAnimation *
+rstto_image_decoder_apply_orientation (
+        RsttoImageDecoderJob *job,
+        GdkPixbufAnimation *animation,
+        gint orientation)
+{
+    GdkPixbufSimpleAnim *upright;
+    GdkPixbuf           *pixbuf;
+    gchar                value[2] = { (gchar) ('0' + orientation), '\0' };
+    const gchar         *applied;
+    gint                 width;
+
+    if (orientation < 2 || orientation > 8 ||
+        FALSE == gdk_pixbuf_animation_is_static_image (animation))
+    {
+        return animation;
+    }
+
+    /* Ignored when the preview has an orientation of its own,
+     * that one is applied instead.
+     */
+    pixbuf = gdk_pixbuf_animation_get_static_image (animation);
+    gdk_pixbuf_set_option (pixbuf, "orientation", value);
+    applied = gdk_pixbuf_get_option (pixbuf, "orientation");
+    if (NULL == applied || applied[0] < '2' || applied[0] > '8')
+    {
+        return animation;
+    }
+
+    pixbuf = gdk_pixbuf_apply_embedded_orientation (pixbuf);
+    if (NULL == pixbuf)
+    {
+        return animation;
+    }
+
+    upright = gdk_pixbuf_simple_anim_new (
+            gdk_pixbuf_get_width (pixbuf),
+            gdk_pixbuf_get_height (pixbuf),
+            1.0);
+    gdk_pixbuf_simple_anim_add_frame (upright, pixbuf);
+    g_object_unref (pixbuf);
+    g_object_unref (animation);
+
+    if (job->default_orientation)
+    {
+        job->orientation = RSTTO_IMAGE_ORIENT_NONE;
+    }
+
+    /* Transposed */
+    if (applied[0] >= '5')
+    {
+        width = job->image_width;
+        job->image_width = job->image_height;
+        job->image_height = width;
+    }
+
+    return GDK_PIXBUF_ANIMATION (upright);
+}
+
+/**
+ * rstto_image_decoder_thread:
+ * @data: The GTask to run
+ * @user_data: The RsttoImageDecoder
+ *
+ * Runs in a worker-thread, only touches the job of the task.
+ */
+static void
+rstto_image_decoder_thread (
+        gpointer data,
+        gpointer user_data)
+{
+    GTask                *task = data;
+    RsttoImageDecoderJob *job = g_task_get_task_data (task);
+    GCancellable         *cancellable = g_task_get_cancellable (task);
+    GdkPixbufLoader      *loader = NULL;
+    GdkPixbufAnimation   *animation = NULL;
+    GMappedFile          *mapped;
+    gint                  fd;
+    GError               *error = NULL;
+    gboolean              raw_preview = FALSE;
+    gsize                 preview_offset = 0;
+    gsize                 preview_size = 0;
+    gint                  orientation = 0;
+    gchar                *content_type;
+
+    if (g_task_return_error_if_cancelled (task))
+    {
+        g_object_unref (task);
+        return;
+    }
+
+    /* The fast content-type is only a guess from the filename */
+    if (NULL != job->path)
+    {
+        content_type = rstto_file_sniff_content_type (job->path);
+        if (NULL != content_type)
+        {
+            g_free (job->content_type);
+            job->content_type = content_type;
+        }
+    }
+
+    mapped = rstto_image_decoder_map_file (job->g_file, &fd);
+
+    /* Decoding the sensor data of a camera raw file is slow,
+     * decode the full-size JPEG-preview it embeds instead.
+     */
+    if (NULL != mapped)
+    {
+        raw_preview = rstto_image_decoder_find_raw_preview (
+                job->content_type,
+                (const guchar *) g_mapped_file_get_contents (mapped),
+                g_mapped_file_get_length (mapped),
+                &preview_offset,
+                &preview_size,
+                &orientation);
+    }
+
+    if (raw_preview)
+    {
+        loader = gdk_pixbuf_loader_new_with_mime_type ("image/jpeg", NULL);
+    }
+    else if (NULL != job->content_type)
+    {
+        loader = gdk_pixbuf_loader_new_with_mime_type (job->content_type, NULL);
+    }
+
+    /* HACK HACK HACK */
+    if (NULL == loader)
+    {
+        loader = gdk_pixbuf_loader_new ();
+    }
+
+    g_signal_connect (
+            loader,
+            "size-prepared",
+            G_CALLBACK (cb_rstto_image_decoder_size_prepared),
+            job);
+
+    /* A preview that still has to be turned would be shown sideways */
+    if (NULL != job->progress_func && orientation < 2)
+    {
+        g_signal_connect (
+                loader,
+                "area-prepared",
+                G_CALLBACK (cb_rstto_image_decoder_area_prepared),
+                task);
+        g_signal_connect (
+                loader,
+                "area-updated",
+                G_CALLBACK (cb_rstto_image_decoder_area_updated),
+                task);
+    }
+
+    if (raw_preview)
+    {
+        rstto_image_decoder_write_mapped (
+                job,
+                loader,
+                mapped,
+                fd,
+                preview_offset,
+                preview_size,
+                cancellable,
+                &error);
+    }
+    else if (NULL != mapped)
+    {
+        rstto_image_decoder_write_mapped (
+                job,
+                loader,
+                mapped,
+                fd,
+                0,
+                g_mapped_file_get_length (mapped),
+                cancellable,
+                &error);
+    }
+    else
+    {
+        rstto_image_decoder_write_stream (job, loader, cancellable, &error);
+    }
+
+    /* The loader has to be closed, even if it failed */
+    if (NULL == error)
+    {
+        gdk_pixbuf_loader_close (loader, &error);
+    }
+    else
+    {
+        gdk_pixbuf_loader_close (loader, NULL);
+    }
+
+    /* The loader is done with the data, the image is not in the map */
+    if (NULL != mapped)
+    {
+        g_mapped_file_unref (mapped);
+        close (fd);
+    }
+
+    if (NULL == error)
+    {
+        animation = gdk_pixbuf_loader_get_animation (loader);
+        if (NULL == animation)
+        {
+            g_set_error_literal (
+                    &error,
+                    GDK_PIXBUF_ERROR,
+                    GDK_PIXBUF_ERROR_FAILED,
+                    _("The image could not be loaded"));
+        }
+        else
+        {
+            g_object_ref (animation);
+        }
+    }
+
+    /* The raw-preview is stored like the sensor data */
+    if (NULL == error && raw_preview)
+    {
+        animation = rstto_image_decoder_apply_orientation (job, animation, orientation);
+    }
+
+    g_atomic_int_set (&job->done, TRUE);
+
+    if (NULL == error)
+    {
+        g_task_return_pointer (task, animation, g_object_unref);
+    }
+    else
+    {
+        g_task_return_error (task, error);
+    }
+
+    g_object_unref (loader);
+    g_object_unref (task);
+}
@@ -0,0 +1,119 @@
+/*
+ *  Copyright (c) Stephan Arts 2006-2012 <stephan@xfce.org>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#ifndef __RISTRETTO_IMAGE_DECODER_H__
+#define __RISTRETTO_IMAGE_DECODER_H__
+
+#include <gtk/gtk.h>
+
+#include "file.h"
+
+G_BEGIN_DECLS
+
+#define RSTTO_TYPE_IMAGE_DECODER rstto_image_decoder_get_type()
+
+#define RSTTO_IMAGE_DECODER(obj)( \
+        G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                RSTTO_TYPE_IMAGE_DECODER, \
+                RsttoImageDecoder))
+
+#define RSTTO_IS_IMAGE_DECODER(obj)( \
+        G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                RSTTO_TYPE_IMAGE_DECODER))
+
+#define RSTTO_IMAGE_DECODER_CLASS(klass)( \
+        G_TYPE_CHECK_CLASS_CAST ((klass), \
+                RSTTO_TYPE_IMAGE_DECODER, \
+                RsttoImageDecoderClass))
+
+#define RSTTO_IS_IMAGE_DECODER_CLASS(klass)( \
+        G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                RSTTO_TYPE_IMAGE_DECODER()))
+
+typedef struct _RsttoImageDecoder RsttoImageDecoder;
+typedef struct _RsttoImageDecoderPriv RsttoImageDecoderPriv;
+
+struct _RsttoImageDecoder
+{
+    GObject parent;
+
+    RsttoImageDecoderPriv *priv;
+};
+
+typedef struct _RsttoImageDecoderClass RsttoImageDecoderClass;
+
+struct _RsttoImageDecoderClass
+{
+    GObjectClass parent_class;
+};
+
+/**
+ * RsttoImageDecoderProgressFunc:
+ * @decoder:
+ * @pixbuf: The pixbuf the loader is decoding into, it is still
+ *          being written to by the worker-thread
+ * @image_width: Width of the image on disk
+ * @image_height: Height of the image on disk
+ * @image_scale: Scale at which the image is decoded
+ * @area: Part of @pixbuf that was decoded since the previous report,
+ *        empty on the first report
+ * @user_data:
+ *
+ * Called in the main-loop while the image is decoded.
+ */
+typedef void (*RsttoImageDecoderProgressFunc) (
+        RsttoImageDecoder *decoder,
+        GdkPixbuf *pixbuf,
+        const GdkRectangle *area,
+        gint image_width,
+        gint image_height,
+        gdouble image_scale,
+        gpointer user_data);
+
+RsttoImageDecoder *
+rstto_image_decoder_new (void);
+
+GType
+rstto_image_decoder_get_type (void);
+
+void
+rstto_image_decoder_decode_async (
+        RsttoImageDecoder *decoder,
+        RsttoFile *file,
+        gint max_width,
+        gint max_height,
+        gint priority,
+        GCancellable *cancellable,
+        RsttoImageDecoderProgressFunc progress_func,
+        GAsyncReadyCallback callback,
+        gpointer user_data);
+
+GdkPixbufAnimation *
+rstto_image_decoder_decode_finish (
+        RsttoImageDecoder *decoder,
+        GAsyncResult *result,
+        gint *image_width,
+        gint *image_height,
+        gdouble *image_scale,
+        RsttoImageOrientation *orientation,
+        GError **error);
+
+G_END_DECLS
+
+#endif /* __RISTRETTO_IMAGE_DECODER_H__ */
@@ -25,8 +25,37 @@
 #include "util.h"
 #include "image_list.h"
 #include "thumbnailer.h"
+#include "metadata_reader.h"
 #include "settings.h"
 
+/* Maximum number of files sent from the scanner-thread
+ * to the main-loop, and merged into the list, at once.
+ */
+#ifndef RSTTO_IMAGE_LIST_BATCH_SIZE
+#define RSTTO_IMAGE_LIST_BATCH_SIZE 1000
+#endif
+
+/* Time in microseconds after which a partial batch is sent
+ * anyway, so slow (network) directories still show progress.
+ */
+#ifndef RSTTO_IMAGE_LIST_BATCH_INTERVAL
+#define RSTTO_IMAGE_LIST_BATCH_INTERVAL 200000
+#endif
+
+/* Time in milliseconds during which file-monitor events
+ * are collected before they are applied to the list.
+ */
+#ifndef RSTTO_IMAGE_LIST_EVENT_INTERVAL
+#define RSTTO_IMAGE_LIST_EVENT_INTERVAL 100
+#endif
+
+/* Time in milliseconds during which arriving metadata
+ * is collected before the list is sorted again.
+ */
+#ifndef RSTTO_IMAGE_LIST_RESORT_INTERVAL
+#define RSTTO_IMAGE_LIST_RESORT_INTERVAL 250
+#endif
+
 static void
 rstto_image_list_tree_model_init (GtkTreeModelIface *iface);
 static void
@@ -70,15 +99,77 @@ cb_rstto_thumbnailer_ready(
         RsttoFile *file,
         gpointer user_data);
 
+static void
+cb_rstto_metadata_reader_ready (
+        RsttoMetadataReader *reader,
+        RsttoFile *file,
+        gpointer user_data);
+static gboolean
+cb_rstto_image_list_resort_timeout (gpointer user_data);
+static void
+rstto_image_list_resort_pending (RsttoImageList *image_list);
+static void
+rstto_image_list_queue_resort (
+        RsttoImageList *image_list,
+        RsttoFile *r_file);
+static void
+rstto_image_list_queue_metadata (
+        RsttoImageList *image_list,
+        RsttoFile *r_file);
+
+typedef struct _RsttoImageListWatch RsttoImageListWatch;
+
+typedef enum
+{
+    RSTTO_IMAGE_LIST_EVENT_ADD     = 1 << 0,
+    RSTTO_IMAGE_LIST_EVENT_REMOVE  = 1 << 1,
+    RSTTO_IMAGE_LIST_EVENT_CHANGED = 1 << 2
+} RsttoImageListEvent;
+
 static void
 rstto_image_list_monitor_dir (
         RsttoImageList *image_list,
         GFile *dir );
+static void
+rstto_image_list_queue_event (
+        RsttoImageList *image_list,
+        GFile *file,
+        RsttoImageListEvent event);
+static gboolean
+cb_rstto_image_list_events_timeout (gpointer user_data);
 
 static void
 rstto_image_list_remove_all (
         RsttoImageList *image_list);
 
+static gboolean
+rstto_image_list_filter_file (
+        RsttoImageList *image_list,
+        RsttoFile *r_file);
+
+static void
+rstto_image_list_monitor_file (
+        RsttoImageList *image_list,
+        RsttoFile *r_file);
+static void
+rstto_image_list_unmonitor_file (
+        RsttoImageList *image_list,
+        RsttoFile *r_file);
+static void
+cb_rstto_image_list_watch_changed (
+        GFileMonitor      *monitor,
+        GFile             *file,
+        GFile             *other_file,
+        GFileMonitorEvent  event_type,
+        gpointer           user_data );
+static void
+rstto_image_list_watch_free (RsttoImageListWatch *watch);
+
+static void
+rstto_image_list_merge_files (
+        RsttoImageList *image_list,
+        GPtrArray *files);
+
 static gboolean
 iter_next (
         RsttoImageListIter *iter,
@@ -172,6 +263,11 @@ static gint
 cb_rstto_image_list_image_type_compare_func (RsttoFile *a, RsttoFile *b);
 static gint
 cb_rstto_image_list_exif_date_compare_func (RsttoFile *a, RsttoFile *b);
+static gint
+cb_rstto_image_list_sequence_compare_func (
+        gconstpointer a,
+        gconstpointer b,
+        gpointer user_data);
 
 static GObjectClass *parent_class = NULL;
 static GObjectClass *iter_parent_class = NULL;
@@ -180,6 +276,7 @@ enum
 {
     RSTTO_IMAGE_LIST_SIGNAL_REMOVE_IMAGE = 0,
     RSTTO_IMAGE_LIST_SIGNAL_REMOVE_ALL,
+    RSTTO_IMAGE_LIST_SIGNAL_ROWS_ADDED,
     RSTTO_IMAGE_LIST_SIGNAL_COUNT
 };
 
@@ -199,39 +296,114 @@ struct _RsttoImageListIterPriv
     gboolean        sticky; 
 };
 
+typedef struct _RsttoFileLoader RsttoFileLoader;
+
+struct _RsttoImageListWatch
+{
+    GFileMonitor *monitor;
+
+    /* The files in the list that live in this directory,
+     * as GFile so events about other files are looked up
+     * without creating an RsttoFile for them.
+     */
+    GHashTable   *members;
+};
+
 struct _RsttoImageListPriv
 {
     gint           stamp;
     GFileMonitor  *dir_monitor;
-    gint           directory_loader;
+    RsttoFileLoader *directory_loader;
     RsttoSettings *settings;
     RsttoThumbnailer *thumbnailer;
     GtkFileFilter *filter;
 
-    GList        *image_monitors;
-    GList        *images;
-    gint          n_images;
+    /* When the list is built from separate files, the parent
+     * directories of those files are watched instead. This maps
+     * every parent directory to its RsttoImageListWatch.
+     */
+    GHashTable   *watches;
+
+    /* The images are kept in a balanced tree, sorted by the
+     * compare-func. The index maps every RsttoFile to its node
+     * in that tree, this makes looking up a file, or the position
+     * of a file, O(log n) instead of walking the entire list.
+     */
+    GSequence    *images;
+    GHashTable   *image_index;
 
     GSList       *iterators;
     GCompareFunc  cb_rstto_image_list_compare_func;
 
+    RsttoMetadataReader *metadata_reader;
+    /* Cancelled when the files are removed, so the reader
+     * skips the jobs of a folder that is no longer shown.
+     */
+    GCancellable        *metadata_cancellable;
+
+    /* Files whose sort-keys changed since they were sorted,
+     * they are moved to their new position in a batch.
+     */
+    GHashTable   *resort_pending;
+    guint         resort_timeout_id;
+
+    /* File-monitor events that are not applied yet,
+     * maps RsttoFile to RsttoImageListEvent flags.
+     */
+    GHashTable   *pending_events;
+    guint         events_timeout_id;
+
     gboolean      wrap_images;
 };
 
-typedef struct _RsttoFileLoader RsttoFileLoader;
-
+/* The file-loader scans a directory in a worker-thread,
+ * the batches it finds are passed to the main-loop through
+ * an async-queue.
+ */
 struct _RsttoFileLoader
 {
+    gint             ref_count;
+
     GFile           *dir;
     RsttoImageList  *image_list;
-    GFileEnumerator *file_enum;
+    GCancellable    *cancellable;
+
+    /* Queue of RsttoFileBatch, filled by the worker-thread */
+    GAsyncQueue     *batches;
+    gint             idle_pending;
 
-    guint            n_files;
-    RsttoFile      **files;
+    /* Progress, updated by the worker-thread */
+    guint            n_scanned;
+    guint            n_estimated;
+
+    /* Buffer for the files of a single batch, used on the
+     * main-loop. It is reused for every batch.
+     */
+    GPtrArray       *files;
+};
+
+typedef struct _RsttoFileBatch RsttoFileBatch;
+
+struct _RsttoFileBatch
+{
+    GPtrArray *files;
+    GPtrArray *file_infos;
+    GPtrArray *collate_keys;
+    gboolean   done;
 };
 
+static RsttoFileLoader *
+rstto_file_loader_ref (RsttoFileLoader *loader);
+static void
+rstto_file_loader_unref (RsttoFileLoader *loader);
+static void
+rstto_file_loader_thread (
+        GTask *task,
+        gpointer source_object,
+        gpointer task_data,
+        GCancellable *cancellable);
 static gboolean
-cb_rstto_read_file ( gpointer user_data );
+cb_rstto_file_loader_batches_ready (gpointer user_data);
 
 static gint rstto_image_list_signals[RSTTO_IMAGE_LIST_SIGNAL_COUNT];
 static gint rstto_image_list_iter_signals[RSTTO_IMAGE_LIST_ITER_SIGNAL_COUNT];
@@ -317,6 +489,23 @@ rstto_image_list_init(RsttoImageList *image_list)
     image_list->priv->stamp = g_random_int();
     image_list->priv->settings = rstto_settings_new ();
     image_list->priv->thumbnailer = rstto_thumbnailer_new();
+    image_list->priv->images = g_sequence_new (NULL);
+    image_list->priv->image_index = g_hash_table_new (g_direct_hash, g_direct_equal);
+    image_list->priv->pending_events = g_hash_table_new_full (
+            g_direct_hash,
+            g_direct_equal,
+            g_object_unref,
+            NULL);
+    image_list->priv->resort_pending = g_hash_table_new_full (
+            g_direct_hash,
+            g_direct_equal,
+            g_object_unref,
+            NULL);
+    image_list->priv->watches = g_hash_table_new_full (
+            g_file_hash,
+            (GEqualFunc) g_file_equal,
+            g_object_unref,
+            (GDestroyNotify) rstto_image_list_watch_free);
     image_list->priv->filter = gtk_file_filter_new ();
     g_object_ref_sink (image_list->priv->filter);
     gtk_file_filter_add_pixbuf_formats (image_list->priv->filter);
@@ -341,6 +530,13 @@ rstto_image_list_init(RsttoImageList *image_list)
             G_CALLBACK (cb_rstto_thumbnailer_ready),
             image_list);
 
+    image_list->priv->metadata_reader = rstto_metadata_reader_new ();
+    image_list->priv->metadata_cancellable = g_cancellable_new ();
+    g_signal_connect (
+            G_OBJECT(image_list->priv->metadata_reader),
+            "ready",
+            G_CALLBACK (cb_rstto_metadata_reader_ready),
+            image_list);
 }
 
 static void
@@ -374,6 +570,17 @@ rstto_image_list_class_init(RsttoImageListClass *nav_class)
             G_TYPE_NONE,
             0,
             NULL);
+
+    rstto_image_list_signals[RSTTO_IMAGE_LIST_SIGNAL_ROWS_ADDED] = g_signal_new("rows-added",
+            G_TYPE_FROM_CLASS(nav_class),
+            G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+            0,
+            NULL,
+            NULL,
+            g_cclosure_marshal_VOID__VOID,
+            G_TYPE_NONE,
+            0,
+            NULL);
 }
 
 static void
@@ -383,6 +590,15 @@ rstto_image_list_dispose(GObject *object)
 
     if (NULL != image_list->priv)
     {
+        if (image_list->priv->directory_loader)
+        {
+            /* The loader cleans up after itself once it
+             * notices it has been cancelled.
+             */
+            g_cancellable_cancel (image_list->priv->directory_loader->cancellable);
+            image_list->priv->directory_loader = NULL;
+        }
+
         if (image_list->priv->settings)
         {
             g_object_unref (image_list->priv->settings);
@@ -395,24 +611,70 @@ rstto_image_list_dispose(GObject *object)
             image_list->priv->thumbnailer = NULL;
         }
 
+        if (image_list->priv->metadata_reader)
+        {
+            g_signal_handlers_disconnect_by_func (
+                    image_list->priv->metadata_reader,
+                    cb_rstto_metadata_reader_ready,
+                    image_list);
+            g_object_unref (image_list->priv->metadata_reader);
+            image_list->priv->metadata_reader = NULL;
+        }
+
+        if (image_list->priv->metadata_cancellable)
+        {
+            g_cancellable_cancel (image_list->priv->metadata_cancellable);
+            g_object_unref (image_list->priv->metadata_cancellable);
+            image_list->priv->metadata_cancellable = NULL;
+        }
+
+        if (image_list->priv->resort_timeout_id)
+        {
+            REMOVE_SOURCE (image_list->priv->resort_timeout_id);
+        }
+
+        if (image_list->priv->resort_pending)
+        {
+            g_hash_table_destroy (image_list->priv->resort_pending);
+            image_list->priv->resort_pending = NULL;
+        }
+
+        if (image_list->priv->events_timeout_id)
+        {
+            REMOVE_SOURCE (image_list->priv->events_timeout_id);
+        }
+
+        if (image_list->priv->pending_events)
+        {
+            g_hash_table_destroy (image_list->priv->pending_events);
+            image_list->priv->pending_events = NULL;
+        }
+
         if (image_list->priv->filter)
         {
             g_object_unref (image_list->priv->filter);
             image_list->priv->filter= NULL;
         }
 
-        if (image_list->priv->image_monitors)
+        if (image_list->priv->watches)
         {
-            g_list_free_full (image_list->priv->image_monitors, (GDestroyNotify) g_object_unref);
-            image_list->priv->image_monitors = NULL;
+            g_hash_table_destroy (image_list->priv->watches);
+            image_list->priv->watches = NULL;
         }
 
         if (image_list->priv->images)
         {
-            g_list_free_full (image_list->priv->images, (GDestroyNotify) g_object_unref);
+            g_sequence_foreach (image_list->priv->images, (GFunc) g_object_unref, NULL);
+            g_sequence_free (image_list->priv->images);
             image_list->priv->images = NULL;
         }
 
+        if (image_list->priv->image_index)
+        {
+            g_hash_table_destroy (image_list->priv->image_index);
+            image_list->priv->image_index = NULL;
+        }
+
         g_free (image_list->priv);
         image_list->priv = NULL;
     }
@@ -434,13 +696,11 @@ rstto_image_list_add_file (
         RsttoFile *r_file,
         GError **error )
 {
-    GtkFileFilterInfo filter_info;
-    GList *image_iter = g_list_find (image_list->priv->images, r_file);
+    GSequenceIter *image_iter = g_hash_table_lookup (image_list->priv->image_index, r_file);
     GSList *iter = image_list->priv->iterators;
     gint i = 0;
     GtkTreePath *path = NULL;
     GtkTreeIter t_iter;
-    GFileMonitor *monitor = NULL;
 
     g_return_val_if_fail ( NULL != r_file , FALSE);
     g_return_val_if_fail ( RSTTO_IS_FILE (r_file) , FALSE);
@@ -449,44 +709,32 @@ rstto_image_list_add_file (
     {
         if (r_file)
         {
-            filter_info.contains =  GTK_FILE_FILTER_MIME_TYPE | GTK_FILE_FILTER_URI;
-            filter_info.uri = rstto_file_get_uri (r_file);
-            filter_info.mime_type = rstto_file_get_content_type (r_file);
-
-            if ( TRUE == gtk_file_filter_filter (image_list->priv->filter, &filter_info))
+            if ( TRUE == rstto_image_list_filter_file (image_list, r_file))
             {
+                /* The list has to be sorted to search it */
+                rstto_image_list_resort_pending (image_list);
+
                 g_object_ref (G_OBJECT (r_file));
 
-                image_list->priv->images = g_list_insert_sorted (
+                image_iter = g_sequence_insert_sorted (
                         image_list->priv->images,
                         r_file,
-                        rstto_image_list_get_compare_func (image_list));
+                        cb_rstto_image_list_sequence_compare_func,
+                        image_list);
+                g_hash_table_insert (
+                        image_list->priv->image_index,
+                        r_file,
+                        image_iter);
 
-                image_list->priv->n_images++;
+                rstto_image_list_monitor_file (image_list, r_file);
+                rstto_image_list_queue_metadata (image_list, r_file);
 
-                if (image_list->priv->dir_monitor == NULL)
-                {
-                    monitor = g_file_monitor_file (
-                            rstto_file_get_file (r_file),
-                            G_FILE_MONITOR_NONE,
-                            NULL,
-                            NULL);
-                    g_signal_connect (
-                            G_OBJECT(monitor),
-                            "changed",
-                            G_CALLBACK (cb_file_monitor_changed),
-                            image_list);
-                    image_list->priv->image_monitors = g_list_prepend (
-                            image_list->priv->image_monitors, 
-                            monitor);
-                }
-                i = g_list_index (image_list->priv->images, r_file);
+                i = g_sequence_iter_get_position (image_iter);
 
                 path = gtk_tree_path_new();
                 gtk_tree_path_append_index (path, i);
                 t_iter.stamp = image_list->priv->stamp;
-                t_iter.user_data = r_file;
-                t_iter.user_data3 = GINT_TO_POINTER(i);
+                t_iter.user_data = image_iter;
 
                 gtk_tree_model_row_inserted (
                         GTK_TREE_MODEL(image_list),
@@ -518,10 +766,340 @@ rstto_image_list_add_file (
     return TRUE;
 }
 
+/**
+ * rstto_image_list_filter_file:
+ * @image_list:
+ * @r_file:
+ *
+ * Return value: TRUE if the file is accepted by the filter
+ */
+static gboolean
+rstto_image_list_filter_file (
+        RsttoImageList *image_list,
+        RsttoFile *r_file)
+{
+    GtkFileFilterInfo filter_info;
+
+    filter_info.contains =  GTK_FILE_FILTER_MIME_TYPE | GTK_FILE_FILTER_URI;
+    filter_info.uri = rstto_file_get_uri (r_file);
+    /* Do not sniff the content-type here, that
+     * is done by the metadata-reader.
+     */
+    filter_info.mime_type = rstto_file_get_known_content_type (r_file);
+
+    return gtk_file_filter_filter (image_list->priv->filter, &filter_info);
+}
+
+static void
+rstto_image_list_watch_free (RsttoImageListWatch *watch)
+{
+    g_file_monitor_cancel (watch->monitor);
+    g_object_unref (watch->monitor);
+    g_hash_table_destroy (watch->members);
+    g_free (watch);
+}
+
+/**
+ * rstto_image_list_monitor_file:
+ * @image_list:
+ * @r_file:
+ *
+ * If the image-list is not monitoring a directory,
+ * monitor the file through a watch on its parent directory.
+ * All files in the same directory share one watch.
+ */
+static void
+rstto_image_list_monitor_file (
+        RsttoImageList *image_list,
+        RsttoFile *r_file)
+{
+    RsttoImageListWatch *watch = NULL;
+    GFileMonitor *monitor = NULL;
+    GFile *parent = NULL;
+
+    if (image_list->priv->dir_monitor != NULL)
+    {
+        return;
+    }
+
+    parent = g_file_get_parent (rstto_file_get_file (r_file));
+    if (NULL == parent)
+    {
+        return;
+    }
+
+    watch = g_hash_table_lookup (image_list->priv->watches, parent);
+    if (NULL == watch)
+    {
+        monitor = g_file_monitor_directory (
+                parent,
+                G_FILE_MONITOR_SEND_MOVED,
+                NULL,
+                NULL);
+        if (NULL == monitor)
+        {
+            g_object_unref (parent);
+            return;
+        }
+
+        g_signal_connect (
+                G_OBJECT(monitor),
+                "changed",
+                G_CALLBACK (cb_rstto_image_list_watch_changed),
+                image_list);
+
+        watch = g_new0 (RsttoImageListWatch, 1);
+        watch->monitor = monitor;
+        watch->members = g_hash_table_new_full (
+                g_file_hash,
+                (GEqualFunc) g_file_equal,
+                g_object_unref,
+                NULL);
+
+        /* The table takes over the reference to parent */
+        g_hash_table_insert (image_list->priv->watches, parent, watch);
+    }
+    else
+    {
+        g_object_unref (parent);
+    }
+
+    g_hash_table_add (watch->members, g_object_ref (rstto_file_get_file (r_file)));
+}
+
+/**
+ * rstto_image_list_unmonitor_file:
+ * @image_list:
+ * @r_file:
+ *
+ * Remove the file from the watch on its parent directory,
+ * the watch is dropped when it has no members left.
+ */
+static void
+rstto_image_list_unmonitor_file (
+        RsttoImageList *image_list,
+        RsttoFile *r_file)
+{
+    RsttoImageListWatch *watch = NULL;
+    GFile *parent = g_file_get_parent (rstto_file_get_file (r_file));
+
+    if (NULL == parent)
+    {
+        return;
+    }
+
+    watch = g_hash_table_lookup (image_list->priv->watches, parent);
+    if (NULL != watch)
+    {
+        g_hash_table_remove (watch->members, rstto_file_get_file (r_file));
+        if (0 == g_hash_table_size (watch->members))
+        {
+            g_hash_table_remove (image_list->priv->watches, parent);
+        }
+    }
+    g_object_unref (parent);
+}
+
+/**
+ * rstto_image_list_watch_has_member:
+ * @image_list:
+ * @file:
+ *
+ * Return value: TRUE if @file is watched as a member of its parent
+ */
+static gboolean
+rstto_image_list_watch_has_member (
+        RsttoImageList *image_list,
+        GFile *file)
+{
+    RsttoImageListWatch *watch = NULL;
+    GFile *parent = NULL;
+    gboolean has_member = FALSE;
+
+    if (NULL == file)
+    {
+        return FALSE;
+    }
+
+    parent = g_file_get_parent (file);
+    if (NULL == parent)
+    {
+        return FALSE;
+    }
+
+    watch = g_hash_table_lookup (image_list->priv->watches, parent);
+    if (NULL != watch)
+    {
+        has_member = g_hash_table_contains (watch->members, file);
+    }
+    g_object_unref (parent);
+
+    return has_member;
+}
+
+/**
+ * cb_rstto_image_list_watch_changed:
+ *
+ * Pass on the events of the parent-directory watches,
+ * but only the ones about files that are in the list.
+ * An atomic save arrives as a move onto a member.
+ */
+static void
+cb_rstto_image_list_watch_changed (
+        GFileMonitor      *monitor,
+        GFile             *file,
+        GFile             *other_file,
+        GFileMonitorEvent  event_type,
+        gpointer           user_data )
+{
+    RsttoImageList *image_list = RSTTO_IMAGE_LIST (user_data);
+
+    if (rstto_image_list_watch_has_member (image_list, file) ||
+        rstto_image_list_watch_has_member (image_list, other_file))
+    {
+        cb_file_monitor_changed (
+                monitor,
+                file,
+                other_file,
+                event_type,
+                user_data);
+    }
+}
+
+static gint
+cb_rstto_image_list_ptr_array_compare_func (
+        gconstpointer a,
+        gconstpointer b,
+        gpointer user_data)
+{
+    return cb_rstto_image_list_sequence_compare_func (
+            *(RsttoFile **)a,
+            *(RsttoFile **)b,
+            user_data);
+}
+
+/**
+ * rstto_image_list_merge_files:
+ * @image_list:
+ * @files: Array of RsttoFile objects, it is filtered and sorted in-place
+ *
+ * Add a batch of files to the image-list. The files are sorted
+ * first and then merged into the list in one pass, afterwards
+ * the views are notified of all new rows with a single
+ * "rows-added" signal and the iterators are updated once.
+ */
+static void
+rstto_image_list_merge_files (
+        RsttoImageList *image_list,
+        GPtrArray *files)
+{
+    GSequence *images = image_list->priv->images;
+    GSequenceIter *cursor;
+    GSequenceIter *image_iter;
+    RsttoFile *r_file;
+    GSList *iter;
+    gboolean linear;
+    guint n_images;
+    guint i = 0;
+
+    /* Drop the files that are already in the list,
+     * or are not accepted by the filter.
+     */
+    while (i < files->len)
+    {
+        r_file = g_ptr_array_index (files, i);
+        if (NULL != g_hash_table_lookup (image_list->priv->image_index, r_file) ||
+            FALSE == rstto_image_list_filter_file (image_list, r_file))
+        {
+            g_ptr_array_remove_index_fast (files, i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    if (files->len == 0)
+    {
+        return;
+    }
+
+    g_ptr_array_sort_with_data (
+            files,
+            cb_rstto_image_list_ptr_array_compare_func,
+            image_list);
+
+    /* The list has to be sorted to merge the batch into it */
+    rstto_image_list_resort_pending (image_list);
+
+    /* Walking the list once costs n + k comparisons, inserting every
+     * file on its own costs k * log (n) comparisons. Pick the cheapest.
+     */
+    n_images = g_sequence_get_length (images);
+    linear = (n_images < files->len * g_bit_storage (n_images));
+
+    cursor = g_sequence_get_begin_iter (images);
+    i = 0;
+    while (i < files->len)
+    {
+        r_file = g_ptr_array_index (files, i);
+
+        /* A file could be in the batch twice, keep the order */
+        if (NULL != g_hash_table_lookup (image_list->priv->image_index, r_file))
+        {
+            g_ptr_array_remove_index (files, i);
+            continue;
+        }
+
+        g_object_ref (G_OBJECT (r_file));
+
+        if (TRUE == linear)
+        {
+            while (!g_sequence_iter_is_end (cursor) &&
+                   cb_rstto_image_list_sequence_compare_func (
+                           g_sequence_get (cursor),
+                           r_file,
+                           image_list) <= 0)
+            {
+                cursor = g_sequence_iter_next (cursor);
+            }
+            image_iter = g_sequence_insert_before (cursor, r_file);
+        }
+        else
+        {
+            image_iter = g_sequence_insert_sorted (
+                    images,
+                    r_file,
+                    cb_rstto_image_list_sequence_compare_func,
+                    image_list);
+        }
+
+        g_hash_table_insert (image_list->priv->image_index, r_file, image_iter);
+
+        rstto_image_list_monitor_file (image_list, r_file);
+        rstto_image_list_queue_metadata (image_list, r_file);
+
+        ++i;
+    }
+
+    /* Views add all rows of the batch at once on "rows-added",
+     * there is no row-inserted signal for every single row.
+     */
+    g_signal_emit (G_OBJECT (image_list), rstto_image_list_signals[RSTTO_IMAGE_LIST_SIGNAL_ROWS_ADDED], 0, NULL);
+
+    for (iter = image_list->priv->iterators; iter != NULL; iter = g_slist_next (iter))
+    {
+        if (FALSE == RSTTO_IMAGE_LIST_ITER(iter->data)->priv->sticky)
+        {
+            rstto_image_list_iter_find_file (iter->data, g_ptr_array_index (files, 0));
+        }
+    }
+}
+
 gint
 rstto_image_list_get_n_images (RsttoImageList *image_list)
 {
-    return g_list_length (image_list->priv->images);
+    return g_sequence_get_length (image_list->priv->images);
 }
 
 /**
@@ -537,10 +1115,11 @@ rstto_image_list_get_iter (RsttoImageList *image_list)
 {
     RsttoFile *r_file = NULL;
     RsttoImageListIter *iter = NULL;
+    GSequenceIter *image_iter = g_sequence_get_begin_iter (image_list->priv->images);
 
-    if (image_list->priv->images)
+    if (FALSE == g_sequence_iter_is_end (image_iter))
     {
-        r_file = image_list->priv->images->data;
+        r_file = g_sequence_get (image_iter);
     }
 
     iter = rstto_image_list_iter_new (image_list, r_file);
@@ -559,11 +1138,13 @@ rstto_image_list_remove_file (
     GSList *iter = NULL;
     RsttoFile *r_file_a = NULL;
     GtkTreePath *path_ = NULL;
-    gint index_ = g_list_index (image_list->priv->images, r_file);
+    GSequenceIter *image_iter = g_hash_table_lookup (image_list->priv->image_index, r_file);
     gint n_images = rstto_image_list_get_n_images (image_list);
+    gint index_;
 
-    if (index_ != -1)
+    if (NULL != image_iter)
     {
+        index_ = g_sequence_iter_get_position (image_iter);
 
         iter = image_list->priv->iterators;
         while (iter)
@@ -587,8 +1168,12 @@ rstto_image_list_remove_file (
                         rstto_image_list_iter_get_file (iter->data),
                         r_file ) )
                 {
-
-                    image_list->priv->images = g_list_remove (image_list->priv->images, r_file);
+                    if (NULL != image_iter)
+                    {
+                        g_hash_table_remove (image_list->priv->image_index, r_file);
+                        g_sequence_remove (image_iter);
+                        image_iter = NULL;
+                    }
                     ((RsttoImageListIter *)(iter->data))->priv->r_file = NULL;
                     g_signal_emit (
                             G_OBJECT (iter->data),
@@ -600,12 +1185,18 @@ rstto_image_list_remove_file (
             iter = g_slist_next (iter);
         }
 
-        image_list->priv->images = g_list_remove (image_list->priv->images, r_file);
+        if (NULL != image_iter)
+        {
+            g_hash_table_remove (image_list->priv->image_index, r_file);
+            g_sequence_remove (image_iter);
+            image_iter = NULL;
+        }
 
         path_ = gtk_tree_path_new();
         gtk_tree_path_append_index(path_,index_);
 
         gtk_tree_model_row_deleted(GTK_TREE_MODEL(image_list), path_);
+        gtk_tree_path_free (path_);
 
         iter = image_list->priv->iterators;
         while (iter)
@@ -627,6 +1218,9 @@ rstto_image_list_remove_file (
                 0,
                 r_file,
                 NULL);
+
+        rstto_image_list_unmonitor_file (image_list, r_file);
+        g_hash_table_remove (image_list->priv->resort_pending, r_file);
         g_object_unref (r_file);
     }
 }
@@ -635,27 +1229,25 @@ static void
 rstto_image_list_remove_all (RsttoImageList *image_list)
 {
     GSList *iter = NULL;
-    GList *image_iter = image_list->priv->images;
-    GtkTreePath *path_ = NULL;
-    gint i = g_list_length (image_iter);
 
-    while (image_iter)
-    {
-        i--;
-        path_ = gtk_tree_path_new();
-        gtk_tree_path_append_index(path_, i);
-
-        gtk_tree_model_row_deleted(GTK_TREE_MODEL(image_list), path_);
-        gtk_tree_path_free (path_);
+    g_hash_table_remove_all (image_list->priv->watches);
 
-        image_iter = g_list_next (image_iter);
-    }
+    /* Drop the metadata-jobs of the files that are removed */
+    g_cancellable_cancel (image_list->priv->metadata_cancellable);
+    g_object_unref (image_list->priv->metadata_cancellable);
+    image_list->priv->metadata_cancellable = g_cancellable_new ();
 
-    g_list_free_full (image_list->priv->image_monitors, (GDestroyNotify) g_object_unref);
-    image_list->priv->image_monitors = NULL;
+    g_hash_table_remove_all (image_list->priv->image_index);
+    g_hash_table_remove_all (image_list->priv->resort_pending);
+    g_sequence_foreach (image_list->priv->images, (GFunc) g_object_unref, NULL);
+    g_sequence_remove_range (
+            g_sequence_get_begin_iter (image_list->priv->images),
+            g_sequence_get_end_iter (image_list->priv->images));
 
-    g_list_free_full (image_list->priv->images, (GDestroyNotify) g_object_unref);
-    image_list->priv->images = NULL;
+    /* Views drop all their rows at once on "remove-all",
+     * there is no row-deleted signal for every single row.
+     */
+    g_signal_emit (G_OBJECT (image_list), rstto_image_list_signals[RSTTO_IMAGE_LIST_SIGNAL_REMOVE_ALL], 0, NULL);
 
     iter = image_list->priv->iterators;
     while (iter)
@@ -663,7 +1255,6 @@ rstto_image_list_remove_all (RsttoImageList *image_list)
         iter_set_position (iter->data, -1, FALSE);
         iter = g_slist_next (iter);
     }
-    g_signal_emit (G_OBJECT (image_list), rstto_image_list_signals[RSTTO_IMAGE_LIST_SIGNAL_REMOVE_ALL], 0, NULL);
 }
 
 gboolean
@@ -673,13 +1264,17 @@ rstto_image_list_set_directory (
         GError **error )
 {
     /* Declare variables */
-    GFileEnumerator *file_enumerator = NULL;
     RsttoFileLoader *loader = NULL;
+    GTask           *task = NULL;
 
     /* Source code block */
-    if (image_list->priv->directory_loader != 0)
+    if (image_list->priv->directory_loader != NULL)
     {
-        REMOVE_SOURCE (image_list->priv->directory_loader);
+        /* The loader cleans up after itself once it
+         * notices it has been cancelled.
+         */
+        g_cancellable_cancel (image_list->priv->directory_loader->cancellable);
+        image_list->priv->directory_loader = NULL;
     }
 
     rstto_image_list_remove_all (image_list);
@@ -691,132 +1286,362 @@ rstto_image_list_set_directory (
     /* Allow all images to be removed by providing NULL to dir */
     if ( NULL != dir )
     {
-        file_enumerator = g_file_enumerate_children (dir, "standard::*", 0, NULL, NULL);
+        g_object_ref (dir);
+
+        loader = g_new0 (RsttoFileLoader, 1);
+        loader->ref_count = 1;
+        loader->dir = dir;
+        loader->image_list = image_list;
+        loader->cancellable = g_cancellable_new ();
+        loader->batches = g_async_queue_new ();
+        loader->files = g_ptr_array_new_full (
+                RSTTO_IMAGE_LIST_BATCH_SIZE,
+                (GDestroyNotify) g_object_unref);
+
+        image_list->priv->directory_loader = loader;
+
+        /* The task owns the initial reference */
+        task = g_task_new (NULL, loader->cancellable, NULL, NULL);
+        g_task_set_task_data (task, loader, (GDestroyNotify) rstto_file_loader_unref);
+        g_task_run_in_thread (task, rstto_file_loader_thread);
+        g_object_unref (task);
+    }
 
-        if (NULL != file_enumerator)
-        {
-            g_object_ref (dir);
+    return TRUE;
+}
+
+static void
+rstto_file_batch_free (RsttoFileBatch *batch)
+{
+    g_ptr_array_free (batch->files, TRUE);
+    g_ptr_array_free (batch->file_infos, TRUE);
+    g_ptr_array_free (batch->collate_keys, TRUE);
+    g_free (batch);
+}
+
+static RsttoFileLoader *
+rstto_file_loader_ref (RsttoFileLoader *loader)
+{
+    g_atomic_int_inc (&loader->ref_count);
+    return loader;
+}
 
-            loader = g_new0 (RsttoFileLoader, 1);
-            loader->dir = dir;
-            loader->file_enum = file_enumerator;
-            loader->image_list = image_list;
+static void
+rstto_file_loader_unref (RsttoFileLoader *loader)
+{
+    RsttoFileBatch *batch;
 
-            image_list->priv->directory_loader = gdk_threads_add_idle (cb_rstto_read_file, loader );
+    if (g_atomic_int_dec_and_test (&loader->ref_count))
+    {
+        while (NULL != (batch = g_async_queue_try_pop (loader->batches)))
+        {
+            rstto_file_batch_free (batch);
         }
+        g_async_queue_unref (loader->batches);
+        g_ptr_array_free (loader->files, TRUE);
+        g_object_unref (loader->cancellable);
+        g_object_unref (loader->dir);
+        g_free (loader);
     }
+}
 
-    return TRUE;
+static RsttoFileBatch *
+rstto_file_batch_new (void)
+{
+    RsttoFileBatch *batch = g_new0 (RsttoFileBatch, 1);
+
+    batch->files = g_ptr_array_new_full (
+            RSTTO_IMAGE_LIST_BATCH_SIZE,
+            g_object_unref);
+    batch->file_infos = g_ptr_array_new_full (
+            RSTTO_IMAGE_LIST_BATCH_SIZE,
+            g_object_unref);
+    batch->collate_keys = g_ptr_array_new_full (
+            RSTTO_IMAGE_LIST_BATCH_SIZE,
+            g_free);
+
+    return batch;
 }
 
-static gboolean
-cb_rstto_read_file ( gpointer user_data )
+/**
+ * rstto_file_loader_push_batch:
+ * @loader:
+ * @batch:
+ *
+ * Hand a batch from the worker-thread to the main-loop.
+ */
+static void
+rstto_file_loader_push_batch (
+        RsttoFileLoader *loader,
+        RsttoFileBatch *batch)
 {
-    RsttoFileLoader *loader = user_data;
-    GFileInfo       *file_info;
-    const gchar     *content_type;
-    const gchar     *filename;
-    RsttoFile      **files;
-    GFile           *child_file;
-    guint            i;
-    GSList          *iter;
+    g_async_queue_push (loader->batches, batch);
 
-    /* Check the inputs */
-    g_return_val_if_fail ( NULL != loader, FALSE );
-    g_return_val_if_fail ( NULL != loader->file_enum, FALSE );
+    /* Only schedule a new idle-handler if there is none
+     * pending, it takes all batches from the queue.
+     */
+    if (g_atomic_int_compare_and_exchange (&loader->idle_pending, 0, 1))
+    {
+        gdk_threads_add_idle_full (
+                G_PRIORITY_DEFAULT_IDLE,
+                cb_rstto_file_loader_batches_ready,
+                rstto_file_loader_ref (loader),
+                (GDestroyNotify) rstto_file_loader_unref);
+    }
+}
 
-    file_info = g_file_enumerator_next_file (
-            loader->file_enum,
-            NULL,
-            NULL );
-    if ( NULL != file_info )
+/**
+ * rstto_file_loader_estimate:
+ * @dir:
+ *
+ * Count the entries of a local directory, reading the names
+ * of a local directory is cheap compared to querying the
+ * content-type of each entry.
+ *
+ * Return value: Number of entries, 0 if unknown
+ */
+static guint
+rstto_file_loader_estimate (GFile *dir)
+{
+    gchar *path = g_file_get_path (dir);
+    GDir  *g_dir = NULL;
+    guint  n_entries = 0;
+
+    if (NULL != path)
     {
-        /* Allow for 'progressive' loading */
-        if (loader->n_files == 100)
+        g_dir = g_dir_open (path, 0, NULL);
+        if (NULL != g_dir)
         {
-            for (i = 0; i < loader->n_files; ++i)
+            while (NULL != g_dir_read_name (g_dir))
             {
-                rstto_image_list_add_file (
-                        loader->image_list,
-                        loader->files[i],
-                        NULL);
-
-                g_object_unref (loader->files[i]);
+                n_entries++;
             }
+            g_dir_close (g_dir);
+        }
+        g_free (path);
+    }
 
-            iter = loader->image_list->priv->iterators;
-            while (iter)
-            {
-                g_signal_emit (G_OBJECT (iter->data), rstto_image_list_iter_signals[RSTTO_IMAGE_LIST_ITER_SIGNAL_CHANGED], 0, NULL);
-                iter = g_slist_next (iter);
-            }
+    return n_entries;
+}
 
-            g_free (loader->files);
-            loader->files = NULL;
-            loader->n_files = 0;
-        }
+static gint
+cb_rstto_file_loader_collate_key_compare_func (
+        gconstpointer a,
+        gconstpointer b,
+        gpointer user_data)
+{
+    GPtrArray   *collate_keys = user_data;
+    const guint *i_a = a;
+    const guint *i_b = b;
 
-        /* Add file to the list */
-        content_type  = g_file_info_get_content_type (file_info);
-        if (content_type && (strncmp (content_type, "image/", 6) == 0))
-        {
-            filename = g_file_info_get_name (file_info);
-            child_file = g_file_get_child (loader->dir, filename);
-            files = g_new0 ( RsttoFile *, loader->n_files+1);
-            files[0] = rstto_file_new (child_file);
+    return g_strcmp0 (
+            g_ptr_array_index (collate_keys, *i_a),
+            g_ptr_array_index (collate_keys, *i_b));
+}
+
+/**
+ * rstto_file_loader_sort_batch:
+ * @batch:
+ *
+ * Sort the batch by collate-key, in the worker-thread.
+ * When sorting by name, the main-loop then only
+ * has to confirm the order.
+ */
+static void
+rstto_file_loader_sort_batch (RsttoFileBatch *batch)
+{
+    GArray    *order;
+    GPtrArray *files;
+    GPtrArray *file_infos;
+    GPtrArray *collate_keys;
+    guint      i;
+    guint      n;
+
+    order = g_array_sized_new (FALSE, FALSE, sizeof (guint), batch->files->len);
+    for (i = 0; i < batch->files->len; ++i)
+    {
+        g_array_append_val (order, i);
+    }
+
+    g_array_sort_with_data (
+            order,
+            cb_rstto_file_loader_collate_key_compare_func,
+            batch->collate_keys);
+
+    files = g_ptr_array_new_full (batch->files->len, g_object_unref);
+    file_infos = g_ptr_array_new_full (batch->files->len, g_object_unref);
+    collate_keys = g_ptr_array_new_full (batch->files->len, g_free);
+    for (i = 0; i < order->len; ++i)
+    {
+        n = g_array_index (order, guint, i);
+        g_ptr_array_add (files, g_ptr_array_index (batch->files, n));
+        g_ptr_array_add (file_infos, g_ptr_array_index (batch->file_infos, n));
+        g_ptr_array_add (collate_keys, g_ptr_array_index (batch->collate_keys, n));
+    }
+
+    /* The new arrays took over the contents */
+    g_ptr_array_set_free_func (batch->files, NULL);
+    g_ptr_array_set_free_func (batch->file_infos, NULL);
+    g_ptr_array_set_free_func (batch->collate_keys, NULL);
+    g_ptr_array_free (batch->files, TRUE);
+    g_ptr_array_free (batch->file_infos, TRUE);
+    g_ptr_array_free (batch->collate_keys, TRUE);
+    batch->files = files;
+    batch->file_infos = file_infos;
+    batch->collate_keys = collate_keys;
+
+    g_array_free (order, TRUE);
+}
+
+/**
+ * rstto_file_loader_thread:
+ *
+ * Scan the directory of the loader, runs in a worker-thread.
+ * It does not touch the image-list, only the loader.
+ */
+static void
+rstto_file_loader_thread (
+        GTask *task,
+        gpointer source_object,
+        gpointer task_data,
+        GCancellable *cancellable)
+{
+    RsttoFileLoader *loader = task_data;
+    RsttoFileBatch  *batch = NULL;
+    GFileEnumerator *file_enum;
+    GFileInfo       *file_info;
+    const gchar     *content_type;
+    gint64           timestamp;
+
+    g_atomic_int_set (&loader->n_estimated, rstto_file_loader_estimate (loader->dir));
+
+    file_enum = g_file_enumerate_children (
+            loader->dir,
+            RSTTO_FILE_INFO_ATTRIBUTES,
+            G_FILE_QUERY_INFO_NONE,
+            cancellable,
+            NULL);
 
-            g_object_unref (child_file);
+    if (NULL != file_enum)
+    {
+        batch = rstto_file_batch_new ();
+        timestamp = g_get_monotonic_time ();
+
+        while (NULL != (file_info = g_file_enumerator_next_file (file_enum, cancellable, NULL)))
+        {
+            g_atomic_int_inc (&loader->n_scanned);
 
-            for (i = 0; i < loader->n_files; ++i)
+            content_type  = g_file_info_get_content_type (file_info);
+            if (content_type && (strncmp (content_type, "image/", 6) == 0))
             {
-                files[i+1] = loader->files[i];
+                g_ptr_array_add (
+                        batch->files,
+                        g_file_get_child (loader->dir, g_file_info_get_name (file_info)));
+                g_ptr_array_add (
+                        batch->collate_keys,
+                        rstto_file_collate_key_new (g_file_info_get_name (file_info)));
+
+                /* The batch takes over the reference */
+                g_ptr_array_add (batch->file_infos, file_info);
+            }
+            else
+            {
+                g_object_unref (file_info);
             }
 
-            if ( NULL != loader->files )
+            if (batch->files->len >= RSTTO_IMAGE_LIST_BATCH_SIZE ||
+                (batch->files->len > 0 &&
+                 g_get_monotonic_time () - timestamp > RSTTO_IMAGE_LIST_BATCH_INTERVAL))
             {
-                g_free (loader->files);
+                rstto_file_loader_sort_batch (batch);
+                rstto_file_loader_push_batch (loader, batch);
+                batch = rstto_file_batch_new ();
+                timestamp = g_get_monotonic_time ();
             }
-            loader->files = files;
-            loader->n_files++;
         }
 
-        g_object_unref (file_info);
+        g_object_unref (file_enum);
     }
-    else
+
+    /* The last batch marks the end of the directory,
+     * even if it is empty.
+     */
+    if (NULL == batch)
     {
-        for (i = 0; i < loader->n_files; ++i)
-        {
-            rstto_image_list_add_file (
-                    loader->image_list,
-                    loader->files[i],
-                    NULL);
+        batch = rstto_file_batch_new ();
+    }
+    rstto_file_loader_sort_batch (batch);
+    batch->done = TRUE;
+    rstto_file_loader_push_batch (loader, batch);
 
-            g_object_unref (loader->files[i]);
-        }
+    g_task_return_boolean (task, TRUE);
+}
 
-        /* This is a hack, use a closure */
-        if (loader->image_list->priv->directory_loader != 0)
-        {
-            REMOVE_SOURCE (loader->image_list->priv->directory_loader);
-        }
+/**
+ * cb_rstto_file_loader_batches_ready:
+ * @user_data: The file-loader
+ *
+ * Merge the batches the worker-thread found into the image-list.
+ */
+static gboolean
+cb_rstto_file_loader_batches_ready (gpointer user_data)
+{
+    RsttoFileLoader *loader = user_data;
+    RsttoFileBatch  *batch;
+    RsttoFile       *r_file;
+    GSList          *iter;
+    gboolean         done = FALSE;
+    guint            i;
 
-        iter = loader->image_list->priv->iterators;
-        while (iter)
+    g_atomic_int_set (&loader->idle_pending, 0);
+
+    /* If the loader is cancelled, the image-list
+     * it belongs to should not be touched.
+     */
+    if (g_cancellable_is_cancelled (loader->cancellable))
+    {
+        return FALSE;
+    }
+
+    while (NULL != (batch = g_async_queue_try_pop (loader->batches)))
+    {
+        for (i = 0; i < batch->files->len; ++i)
         {
-            g_signal_emit (G_OBJECT (iter->data), rstto_image_list_iter_signals[RSTTO_IMAGE_LIST_ITER_SIGNAL_CHANGED], 0, NULL);
-            iter = g_slist_next (iter);
+            r_file = rstto_file_new (g_ptr_array_index (batch->files, i));
+            rstto_file_set_info (r_file, g_ptr_array_index (batch->file_infos, i));
+            rstto_file_set_collate_key (r_file, g_ptr_array_index (batch->collate_keys, i));
+            g_ptr_array_index (batch->collate_keys, i) = NULL;
+            g_ptr_array_add (loader->files, r_file);
         }
 
-        if (loader->n_files > 0)
+        if (loader->files->len > 0)
         {
-            g_free (loader->files);
+            rstto_image_list_merge_files (loader->image_list, loader->files);
+
+            /* Empty the buffer, this releases the references
+             * to the files but keeps the allocated memory.
+             */
+            g_ptr_array_set_size (loader->files, 0);
         }
-        g_object_unref (loader->file_enum);
-        g_free (loader);
 
-        return FALSE;
+        done = batch->done;
+        rstto_file_batch_free (batch);
     }
-    return TRUE;
+
+    if (TRUE == done)
+    {
+        loader->image_list->priv->directory_loader = NULL;
+    }
+
+    /* Allow for 'progressive' loading */
+    iter = loader->image_list->priv->iterators;
+    while (iter)
+    {
+        g_signal_emit (G_OBJECT (iter->data), rstto_image_list_iter_signals[RSTTO_IMAGE_LIST_ITER_SIGNAL_CHANGED], 0, NULL);
+        iter = g_slist_next (iter);
+    }
+
+    return FALSE;
 }
 
 static void
@@ -851,83 +1676,211 @@ rstto_image_list_monitor_dir (
         }
     }
 
-    if (image_list->priv->image_monitors)
+    g_hash_table_remove_all (image_list->priv->watches);
+
+    /* Events of the old monitors do not apply anymore */
+    g_hash_table_remove_all (image_list->priv->pending_events);
+    if (image_list->priv->events_timeout_id)
     {
-        g_list_free_full (image_list->priv->image_monitors, (GDestroyNotify) g_object_unref);
-        image_list->priv->image_monitors = NULL;
+        REMOVE_SOURCE (image_list->priv->events_timeout_id);
     }
 
     image_list->priv->dir_monitor = monitor;
 }
 
 static void
-cb_file_monitor_changed (
-        GFileMonitor      *monitor,
-        GFile             *file,
-        GFile             *other_file,
-        GFileMonitorEvent  event_type,
-        gpointer           user_data )
+cb_file_monitor_changed (
+        GFileMonitor      *monitor,
+        GFile             *file,
+        GFile             *other_file,
+        GFileMonitorEvent  event_type,
+        gpointer           user_data )
+{
+    RsttoImageList *image_list = RSTTO_IMAGE_LIST (user_data);
+
+    /* The list itself is only updated once events stop arriving
+     * for a moment, see cb_rstto_image_list_events_timeout.
+     */
+    switch ( event_type )
+    {
+        case G_FILE_MONITOR_EVENT_DELETED:
+            rstto_image_list_queue_event (image_list, file, RSTTO_IMAGE_LIST_EVENT_REMOVE);
+            break;
+        case G_FILE_MONITOR_EVENT_CREATED:
+            rstto_image_list_queue_event (image_list, file, RSTTO_IMAGE_LIST_EVENT_ADD);
+            break;
+        case G_FILE_MONITOR_EVENT_MOVED:
+            rstto_image_list_queue_event (image_list, file, RSTTO_IMAGE_LIST_EVENT_REMOVE);
+            if (NULL != other_file)
+            {
+                rstto_image_list_queue_event (image_list, other_file, RSTTO_IMAGE_LIST_EVENT_ADD);
+            }
+            break;
+        case G_FILE_MONITOR_EVENT_CHANGED:
+            rstto_image_list_queue_event (image_list, file, RSTTO_IMAGE_LIST_EVENT_CHANGED);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * rstto_image_list_queue_event:
+ * @image_list:
+ * @file:
+ * @event:
+ *
+ * Record a file-monitor event, combined with the events
+ * that are pending for the same file.
+ */
+static void
+rstto_image_list_queue_event (
+        RsttoImageList *image_list,
+        GFile *file,
+        RsttoImageListEvent event)
 {
-    RsttoImageList *image_list = RSTTO_IMAGE_LIST (user_data);
     RsttoFile *r_file = rstto_file_new (file);
+    RsttoImageListEvent pending = GPOINTER_TO_UINT (
+            g_hash_table_lookup (image_list->priv->pending_events, r_file));
 
-    switch ( event_type )
+    switch (event)
     {
-        case G_FILE_MONITOR_EVENT_DELETED:
-            rstto_image_list_remove_file ( image_list, r_file );
-            if (image_list->priv->dir_monitor == NULL)
+        case RSTTO_IMAGE_LIST_EVENT_REMOVE:
+            /* A file that is created and deleted again,
+             * before it made it to the list, is ignored.
+             */
+            if (NULL == g_hash_table_lookup (image_list->priv->image_index, r_file))
             {
-                image_list->priv->image_monitors = g_list_remove (
-                        image_list->priv->image_monitors,
-                        monitor);   
-                g_object_unref (monitor);
-                monitor = NULL;
+                pending = 0;
+            }
+            else
+            {
+                pending = RSTTO_IMAGE_LIST_EVENT_REMOVE;
             }
             break;
-        case G_FILE_MONITOR_EVENT_CREATED:
-            rstto_image_list_add_file (image_list, r_file, NULL);
-            break;
-        case G_FILE_MONITOR_EVENT_MOVED:
-            rstto_image_list_remove_file ( image_list, r_file );
-
-            /* Remove our reference, reusing pointer */
-            g_object_unref (r_file);
-
-            r_file = rstto_file_new (other_file);
-            rstto_image_list_add_file (image_list, r_file, NULL);
+        case RSTTO_IMAGE_LIST_EVENT_ADD:
+            /* A file that is deleted and created again has been replaced */
+            if (pending & RSTTO_IMAGE_LIST_EVENT_REMOVE)
+            {
+                pending = RSTTO_IMAGE_LIST_EVENT_CHANGED;
+            }
 
-            if (image_list->priv->dir_monitor == NULL)
+            /* So has a listed file that is created, an atomic save
+             * renames a new file over it without deleting it first.
+             */
+            if (NULL != g_hash_table_lookup (image_list->priv->image_index, r_file))
             {
-                image_list->priv->image_monitors = g_list_remove (
-                        image_list->priv->image_monitors,
-                        monitor);   
-                g_object_unref (monitor);
-                monitor = g_file_monitor_file (
-                        other_file,
-                        G_FILE_MONITOR_NONE,
-                        NULL,
-                        NULL);
-                g_signal_connect (
-                        G_OBJECT(monitor),
-                        "changed",
-                        G_CALLBACK (cb_file_monitor_changed),
-                        image_list);
-                image_list->priv->image_monitors = g_list_prepend (
-                        image_list->priv->image_monitors, 
-                        monitor);
+                pending |= RSTTO_IMAGE_LIST_EVENT_CHANGED;
+            }
+            else
+            {
+                pending |= RSTTO_IMAGE_LIST_EVENT_ADD;
             }
             break;
-        case G_FILE_MONITOR_EVENT_CHANGED:
-            rstto_file_changed (r_file);
-            break;
-        default:
+        case RSTTO_IMAGE_LIST_EVENT_CHANGED:
+            if (0 == (pending & RSTTO_IMAGE_LIST_EVENT_REMOVE))
+            {
+                pending |= RSTTO_IMAGE_LIST_EVENT_CHANGED;
+            }
             break;
     }
 
-    if ( NULL != r_file )
+    if (0 == pending)
     {
+        g_hash_table_remove (image_list->priv->pending_events, r_file);
         g_object_unref (r_file);
+        return;
+    }
+
+    /* The table keeps the reference */
+    g_hash_table_replace (image_list->priv->pending_events, r_file, GUINT_TO_POINTER (pending));
+
+    if (0 == image_list->priv->events_timeout_id)
+    {
+        image_list->priv->events_timeout_id = gdk_threads_add_timeout (
+                RSTTO_IMAGE_LIST_EVENT_INTERVAL,
+                cb_rstto_image_list_events_timeout,
+                image_list);
+    }
+}
+
+/**
+ * cb_rstto_image_list_events_timeout:
+ * @user_data: The image-list
+ *
+ * Apply the pending file-monitor events, the new files
+ * are merged into the list as a single batch.
+ */
+static gboolean
+cb_rstto_image_list_events_timeout (gpointer user_data)
+{
+    RsttoImageList      *image_list = RSTTO_IMAGE_LIST (user_data);
+    GHashTable          *pending_events = image_list->priv->pending_events;
+    GHashTableIter       hash_iter;
+    gpointer             key;
+    gpointer             value;
+    RsttoImageListEvent  events;
+    GPtrArray           *added;
+    GSList              *iter;
+
+    image_list->priv->events_timeout_id = 0;
+
+    /* Handlers may cause new events, they go to a new table */
+    image_list->priv->pending_events = g_hash_table_new_full (
+            g_direct_hash,
+            g_direct_equal,
+            g_object_unref,
+            NULL);
+
+    added = g_ptr_array_new_with_free_func (g_object_unref);
+
+    g_hash_table_iter_init (&hash_iter, pending_events);
+    while (g_hash_table_iter_next (&hash_iter, &key, &value))
+    {
+        events = GPOINTER_TO_UINT (value);
+
+        if (events & RSTTO_IMAGE_LIST_EVENT_REMOVE)
+        {
+            rstto_image_list_remove_file (image_list, key);
+            continue;
+        }
+        if (events & RSTTO_IMAGE_LIST_EVENT_CHANGED)
+        {
+            rstto_file_changed (key);
+
+            /* The modification-time it is sorted by changed, and
+             * the exif-data has to be read again.
+             */
+            if (NULL != g_hash_table_lookup (image_list->priv->image_index, key))
+            {
+                rstto_image_list_queue_resort (image_list, key);
+                rstto_image_list_queue_metadata (image_list, key);
+            }
+        }
+        if (events & RSTTO_IMAGE_LIST_EVENT_ADD)
+        {
+            g_ptr_array_add (added, g_object_ref (key));
+        }
+    }
+
+    if (added->len > 0)
+    {
+        rstto_image_list_merge_files (image_list, added);
+
+        for (iter = image_list->priv->iterators; iter != NULL; iter = g_slist_next (iter))
+        {
+            g_signal_emit (
+                    G_OBJECT (iter->data),
+                    rstto_image_list_iter_signals[RSTTO_IMAGE_LIST_ITER_SIGNAL_CHANGED],
+                    0,
+                    NULL);
+        }
     }
+
+    g_ptr_array_free (added, TRUE);
+    g_hash_table_destroy (pending_events);
+
+    return FALSE;
 }
 
 
@@ -1038,9 +1991,7 @@ rstto_image_list_iter_find_file (
         RsttoImageListIter *iter,
         RsttoFile *r_file)
 {
-    gint pos = g_list_index (iter->priv->image_list->priv->images, r_file);
-
-    if (pos > -1)
+    if (NULL != g_hash_table_lookup (iter->priv->image_list->priv->image_index, r_file))
     {
         g_signal_emit (
                 G_OBJECT (iter),
@@ -1069,11 +2020,21 @@ rstto_image_list_iter_find_file (
 gint
 rstto_image_list_iter_get_position (RsttoImageListIter *iter)
 {
+    GSequenceIter *image_iter;
+
     if ( NULL == iter->priv->r_file )
     {
         return -1;
     }
-    return g_list_index (iter->priv->image_list->priv->images, iter->priv->r_file);
+
+    image_iter = g_hash_table_lookup (
+            iter->priv->image_list->priv->image_index,
+            iter->priv->r_file);
+    if ( NULL == image_iter )
+    {
+        return -1;
+    }
+    return g_sequence_iter_get_position (image_iter);
 }
 
 RsttoFile *
@@ -1088,6 +2049,8 @@ iter_set_position (
         gint pos,
         gboolean sticky )
 {
+    GSequenceIter *image_iter;
+
     g_signal_emit (
             G_OBJECT (iter),
             rstto_image_list_iter_signals[RSTTO_IMAGE_LIST_ITER_SIGNAL_PREPARE_CHANGE],
@@ -1101,7 +2064,11 @@ iter_set_position (
 
     if (pos >= 0)
     {
-        iter->priv->r_file = g_list_nth_data (iter->priv->image_list->priv->images, pos); 
+        image_iter = g_sequence_get_iter_at_pos (iter->priv->image_list->priv->images, pos);
+        if (FALSE == g_sequence_iter_is_end (image_iter))
+        {
+            iter->priv->r_file = g_sequence_get (image_iter);
+        }
     }
 
     g_signal_emit (
@@ -1124,8 +2091,9 @@ iter_next (
         RsttoImageListIter *iter,
         gboolean sticky)
 {
-    GList *position = NULL;
+    GSequenceIter *position = NULL;
     RsttoImageList *image_list = iter->priv->image_list;
+    GSequence *images = image_list->priv->images;
     RsttoFile *r_file = iter->priv->r_file;
     gboolean ret_val = FALSE;
 
@@ -1137,16 +2105,20 @@ iter_next (
 
     if (r_file)
     {
-        position = g_list_find (iter->priv->image_list->priv->images, r_file);
+        position = g_hash_table_lookup (image_list->priv->image_index, r_file);
         iter->priv->r_file = NULL;
     }
 
     iter->priv->sticky = sticky;
 
-    position = g_list_next (position);
     if (position)
     {
-        iter->priv->r_file = position->data; 
+        position = g_sequence_iter_next (position);
+    }
+
+    if (position && !g_sequence_iter_is_end (position))
+    {
+        iter->priv->r_file = g_sequence_get (position);
 
         /* We could move forward, set ret_val to TRUE */
         ret_val = TRUE;
@@ -1156,7 +2128,7 @@ iter_next (
 
         if (TRUE == image_list->priv->wrap_images)
         {
-            position = g_list_first (iter->priv->image_list->priv->images);
+            position = g_sequence_get_begin_iter (images);
 
             /* We could move forward, wrapped back to the start of the
              * list, set ret_val to TRUE
@@ -1165,12 +2137,12 @@ iter_next (
         }
         else
         {
-            position = g_list_last (iter->priv->image_list->priv->images);
+            position = g_sequence_iter_prev (g_sequence_get_end_iter (images));
         }
 
-        if (position)
+        if (!g_sequence_iter_is_end (position))
         {
-            iter->priv->r_file = position->data; 
+            iter->priv->r_file = g_sequence_get (position);
         }
         else
         {
@@ -1224,8 +2196,9 @@ iter_previous (
         RsttoImageListIter *iter,
         gboolean sticky)
 {
-    GList *position = NULL;
+    GSequenceIter *position = NULL;
     RsttoImageList *image_list = iter->priv->image_list;
+    GSequence *images = image_list->priv->images;
     RsttoFile *r_file = iter->priv->r_file;
     gboolean ret_val = FALSE;
 
@@ -1237,31 +2210,31 @@ iter_previous (
 
     if (iter->priv->r_file)
     {
-        position = g_list_find (iter->priv->image_list->priv->images, iter->priv->r_file);
+        position = g_hash_table_lookup (image_list->priv->image_index, iter->priv->r_file);
         iter->priv->r_file = NULL;
     }
 
     iter->priv->sticky = sticky;
 
-    position = g_list_previous (position);
-    if (position)
+    if (position && !g_sequence_iter_is_begin (position))
     {
-        iter->priv->r_file = position->data; 
+        position = g_sequence_iter_prev (position);
+        iter->priv->r_file = g_sequence_get (position);
     }
     else
     {
         if (TRUE == image_list->priv->wrap_images)
         {
-            position = g_list_last (iter->priv->image_list->priv->images);
+            position = g_sequence_iter_prev (g_sequence_get_end_iter (images));
         }
         else
         {
-            position = g_list_first (iter->priv->image_list->priv->images);
+            position = g_sequence_get_begin_iter (images);
         }
 
-        if (position)
+        if (!g_sequence_iter_is_end (position))
         {
-            iter->priv->r_file = position->data; 
+            iter->priv->r_file = g_sequence_get (position);
         }
         else
         {
@@ -1335,8 +2308,23 @@ void
 rstto_image_list_set_compare_func (RsttoImageList *image_list, GCompareFunc func)
 {
     GSList *iter = NULL;
+    GSequenceIter *image_iter = NULL;
+
     image_list->priv->cb_rstto_image_list_compare_func = func;
-    image_list->priv->images = g_list_sort (image_list->priv->images,  func);
+
+    for (image_iter = g_sequence_get_begin_iter (image_list->priv->images);
+         !g_sequence_iter_is_end (image_iter);
+         image_iter = g_sequence_iter_next (image_iter))
+    {
+        rstto_image_list_queue_metadata (image_list, g_sequence_get (image_iter));
+    }
+
+    /* Sorting all of the list covers the files that were pending */
+    g_hash_table_remove_all (image_list->priv->resort_pending);
+    g_sequence_sort (
+            image_list->priv->images,
+            cb_rstto_image_list_sequence_compare_func,
+            image_list);
 
     for (iter = image_list->priv->iterators; iter != NULL; iter = g_slist_next (iter))
     {
@@ -1398,8 +2386,8 @@ cb_rstto_image_list_image_name_compare_func (RsttoFile *a, RsttoFile *b)
 static gint
 cb_rstto_image_list_image_type_compare_func (RsttoFile *a, RsttoFile *b)
 {
-    const gchar *a_content_type = rstto_file_get_content_type (a);
-    const gchar *b_content_type = rstto_file_get_content_type (b);
+    const gchar *a_content_type = rstto_file_get_known_content_type (a);
+    const gchar *b_content_type = rstto_file_get_known_content_type (b);
 
     return g_strcmp0(a_content_type, b_content_type);
 }
@@ -1409,21 +2397,50 @@ cb_rstto_image_list_image_type_compare_func (RsttoFile *a, RsttoFile *b)
  * @a:
  * @b:
  *
- * TODO: Use EXIF data if available, not the last-modification-time.
+ * Compare the capture dates from the EXIF data, as far as the
+ * metadata-reader has read them. Files without one are sorted
+ * by their last-modification-time. Files with the same date
+ * are sorted by name.
  *
  * Return value: (see strcmp)
  */
 static gint
 cb_rstto_image_list_exif_date_compare_func (RsttoFile *a, RsttoFile *b)
 {
-    guint64 a_t = rstto_file_get_modified_time (a);
-    guint64 b_t = rstto_file_get_modified_time (b);
+    gint64 a_t = rstto_file_get_sort_date (a);
+    gint64 b_t = rstto_file_get_sort_date (b);
 
     if (a_t < b_t)
     {
         return -1;
     }
-    return 1;
+    if (a_t > b_t)
+    {
+        return 1;
+    }
+    return cb_rstto_image_list_image_name_compare_func (a, b);
+}
+
+/**
+ * cb_rstto_image_list_sequence_compare_func:
+ * @a:
+ * @b:
+ * @user_data: The image-list
+ *
+ * Adapt the GCompareFunc of the image-list to the
+ * GCompareDataFunc that is used by GSequence.
+ *
+ * Return value: (see strcmp)
+ */
+static gint
+cb_rstto_image_list_sequence_compare_func (
+        gconstpointer a,
+        gconstpointer b,
+        gpointer user_data)
+{
+    RsttoImageList *image_list = user_data;
+
+    return image_list->priv->cb_rstto_image_list_compare_func (a, b);
 }
 
 gboolean
@@ -1503,7 +2520,7 @@ image_list_model_get_iter (
     gint depth;
     gint index_;
     RsttoImageList *image_list;
-    RsttoFile *file = NULL;
+    GSequenceIter *image_iter = NULL;
 
     g_return_val_if_fail(RSTTO_IS_IMAGE_LIST(tree_model), FALSE);
 
@@ -1519,10 +2536,10 @@ image_list_model_get_iter (
 
     if (index_ >= 0)
     {
-        file = g_list_nth_data (image_list->priv->images, index_);
+        image_iter = g_sequence_get_iter_at_pos (image_list->priv->images, index_);
     }
 
-    if (NULL == file)
+    if (NULL == image_iter || g_sequence_iter_is_end (image_iter))
     {
         return FALSE;
     }
@@ -1530,10 +2547,10 @@ image_list_model_get_iter (
     /* set the stamp, identify the iter as ours */
     iter->stamp = image_list->priv->stamp;
 
-    iter->user_data = file;
-
-    /* the index_ in the child list */
-    iter->user_data3 = GINT_TO_POINTER(index_);
+    /* The sequence-iter stays valid until the file is
+     * removed from the list, see GTK_TREE_MODEL_ITERS_PERSIST
+     */
+    iter->user_data = image_iter;
     return TRUE;
 }
 
@@ -1547,7 +2564,7 @@ image_list_model_get_path (
 
     g_return_val_if_fail(RSTTO_IS_IMAGE_LIST(tree_model), NULL);
 
-    pos = GPOINTER_TO_INT (iter->user_data3);
+    pos = g_sequence_iter_get_position (iter->user_data);
 
     path = gtk_tree_path_new();
     gtk_tree_path_append_index(path, pos);
@@ -1561,7 +2578,7 @@ image_list_model_iter_children (
         GtkTreeIter *iter,
         GtkTreeIter *parent )
 {
-    RsttoFile *file = NULL;
+    GSequenceIter *image_iter = NULL;
     RsttoImageList *image_list;
 
     g_return_val_if_fail(RSTTO_IS_IMAGE_LIST(tree_model), FALSE);
@@ -1571,16 +2588,15 @@ image_list_model_iter_children (
 
     image_list = RSTTO_IMAGE_LIST (tree_model);
     
-    file = g_list_nth_data (image_list->priv->images, 0);
+    image_iter = g_sequence_get_begin_iter (image_list->priv->images);
 
-    if (NULL == file)
+    if (g_sequence_iter_is_end (image_iter))
     {
         return FALSE;
     }
 
     iter->stamp = image_list->priv->stamp;
-    iter->user_data = file;
-    iter->user_data3 = GINT_TO_POINTER(0);
+    iter->user_data = image_iter;
 
     return TRUE;
 }
@@ -1607,7 +2623,15 @@ image_list_model_iter_n_children (
         GtkTreeModel *tree_model,
         GtkTreeIter *iter )
 {
-    return FALSE;
+    g_return_val_if_fail(RSTTO_IS_IMAGE_LIST(tree_model), 0);
+
+    /* Only the (virtual) root-node has children */
+    if (NULL != iter)
+    {
+        return 0;
+    }
+
+    return g_sequence_get_length (RSTTO_IMAGE_LIST (tree_model)->priv->images);
 }
 
 static gboolean 
@@ -1617,7 +2641,28 @@ image_list_model_iter_nth_child (
         GtkTreeIter *parent,
         gint n )
 {
-    return FALSE;
+    RsttoImageList *image_list;
+    GSequenceIter *image_iter;
+
+    g_return_val_if_fail(RSTTO_IS_IMAGE_LIST(tree_model), FALSE);
+
+    if (NULL != parent || n < 0)
+    {
+        return FALSE;
+    }
+
+    image_list = RSTTO_IMAGE_LIST (tree_model);
+    image_iter = g_sequence_get_iter_at_pos (image_list->priv->images, n);
+
+    if (g_sequence_iter_is_end (image_iter))
+    {
+        return FALSE;
+    }
+
+    iter->stamp = image_list->priv->stamp;
+    iter->user_data = image_iter;
+
+    return TRUE;
 }
 
 static gboolean
@@ -1626,26 +2671,21 @@ image_list_model_iter_next (
         GtkTreeIter *iter )
 {
     RsttoImageList *image_list;
-    RsttoFile *file = NULL;
-    gint pos = 0;
+    GSequenceIter *image_iter;
 
     g_return_val_if_fail(RSTTO_IS_IMAGE_LIST(tree_model), FALSE);
 
     image_list = RSTTO_IMAGE_LIST (tree_model);
 
-    pos = GPOINTER_TO_INT(iter->user_data3);
-    pos++;
-
-    file = g_list_nth_data (image_list->priv->images, pos);
+    image_iter = g_sequence_iter_next (iter->user_data);
 
-    if (NULL == file)
+    if (g_sequence_iter_is_end (image_iter))
     {
         return FALSE;
     }
 
     iter->stamp = image_list->priv->stamp;
-    iter->user_data = file;
-    iter->user_data3 = GINT_TO_POINTER(pos);
+    iter->user_data = image_iter;
 
     return TRUE;
 }
@@ -1657,7 +2697,7 @@ image_list_model_get_value (
         gint column,
         GValue *value )
 {
-    RsttoFile *file = RSTTO_FILE(iter->user_data);
+    RsttoFile *file = RSTTO_FILE (g_sequence_get (iter->user_data));
 
     switch (column)
     {
@@ -1677,28 +2717,290 @@ cb_rstto_thumbnailer_ready(
     RsttoImageList *image_list = RSTTO_IMAGE_LIST (user_data);
     GtkTreePath *path_ = NULL;
     GtkTreeIter iter;
-    gint index_;
+    GSequenceIter *image_iter;
 
-    index_ = g_list_index (image_list->priv->images, file);
-    if (index_ >= 0)
+    image_iter = g_hash_table_lookup (image_list->priv->image_index, file);
+    if (NULL != image_iter)
     {
         path_ = gtk_tree_path_new();
-        gtk_tree_path_append_index(path_,index_);
-        gtk_tree_model_get_iter (GTK_TREE_MODEL (image_list), &iter, path_);
+        gtk_tree_path_append_index(path_, g_sequence_iter_get_position (image_iter));
+        iter.stamp = image_list->priv->stamp;
+        iter.user_data = image_iter;
 
         gtk_tree_model_row_changed (GTK_TREE_MODEL(image_list), path_, &iter);
         gtk_tree_path_free (path_);
     }
 }
 
+/**
+ * rstto_image_list_queue_metadata:
+ * @image_list:
+ * @r_file:
+ *
+ * Have the content-type of @r_file sniffed in the background,
+ * and the exif-data read if the list is sorted by date.
+ */
+static void
+rstto_image_list_queue_metadata (
+        RsttoImageList *image_list,
+        RsttoFile *r_file)
+{
+    RsttoMetadataFlags flags = RSTTO_METADATA_CONTENT_TYPE;
+
+    if (image_list->priv->cb_rstto_image_list_compare_func ==
+            (GCompareFunc)cb_rstto_image_list_exif_date_compare_func)
+    {
+        flags |= RSTTO_METADATA_EXIF;
+    }
+
+    rstto_metadata_reader_queue_file (
+            image_list->priv->metadata_reader,
+            r_file,
+            flags,
+            image_list->priv->metadata_cancellable);
+}
+
+static void
+cb_rstto_metadata_reader_ready (
+        RsttoMetadataReader *reader,
+        RsttoFile *file,
+        gpointer user_data)
+{
+    RsttoImageList *image_list = RSTTO_IMAGE_LIST (user_data);
+
+    if (NULL == g_hash_table_lookup (image_list->priv->image_index, file))
+    {
+        return;
+    }
+
+    /* The sniffed content-type can differ from the one
+     * the file was accepted with.
+     */
+    if (FALSE == rstto_image_list_filter_file (image_list, file))
+    {
+        rstto_image_list_remove_file (image_list, file);
+        return;
+    }
+
+    /* Only the date and type sort on fields the reader provides */
+    if ((image_list->priv->cb_rstto_image_list_compare_func !=
+            (GCompareFunc)cb_rstto_image_list_exif_date_compare_func &&
+         image_list->priv->cb_rstto_image_list_compare_func !=
+            (GCompareFunc)cb_rstto_image_list_image_type_compare_func))
+    {
+        return;
+    }
+
+    rstto_image_list_queue_resort (image_list, file);
+}
+
+/**
+ * rstto_image_list_queue_resort:
+ * @image_list:
+ * @r_file: A file in the list whose sort-keys changed
+ *
+ * Collect the files whose sort-keys change in a short
+ * interval, and move them all at once.
+ */
+static void
+rstto_image_list_queue_resort (
+        RsttoImageList *image_list,
+        RsttoFile *r_file)
+{
+    if (FALSE == g_hash_table_contains (image_list->priv->resort_pending, r_file))
+    {
+        g_hash_table_add (image_list->priv->resort_pending, g_object_ref (r_file));
+    }
+
+    if (0 == image_list->priv->resort_timeout_id)
+    {
+        image_list->priv->resort_timeout_id = gdk_threads_add_timeout (
+                RSTTO_IMAGE_LIST_RESORT_INTERVAL,
+                cb_rstto_image_list_resort_timeout,
+                image_list);
+    }
+}
+
+static gint
+cb_rstto_image_list_int_compare_func (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    return *(const gint *) a - *(const gint *) b;
+}
+
+/**
+ * rstto_image_list_resort_pending:
+ * @image_list:
+ *
+ * Move the files whose sort-keys changed to their new position,
+ * and notify the views of the new order. The other files stay
+ * sorted relative to each other, so only the pending ones are
+ * searched for.
+ */
+static void
+rstto_image_list_resort_pending (RsttoImageList *image_list)
+{
+    GSequence      *images = image_list->priv->images;
+    GSequence      *moving;
+    GSequenceIter **image_iters;
+    GHashTableIter  hash_iter;
+    gpointer        r_file;
+    GtkTreePath    *path;
+    gboolean        reordered = FALSE;
+    gint           *old_positions;
+    gint           *new_order;
+    gint            n_images;
+    gint            n_moving;
+    gint            pos, old_pos;
+    gint            i, j;
+
+    n_moving = g_hash_table_size (image_list->priv->resort_pending);
+    if (0 == n_moving)
+    {
+        return;
+    }
+
+    image_iters = g_new (GSequenceIter *, n_moving);
+    old_positions = g_new (gint, n_moving);
+
+    i = 0;
+    g_hash_table_iter_init (&hash_iter, image_list->priv->resort_pending);
+    while (g_hash_table_iter_next (&hash_iter, &r_file, NULL))
+    {
+        image_iters[i] = g_hash_table_lookup (image_list->priv->image_index, r_file);
+        old_positions[i] = g_sequence_iter_get_position (image_iters[i]);
+        ++i;
+    }
+
+    /* Take the files out, so the list they are put back into is
+     * sorted. Moving keeps the GSequenceIters valid, and with them
+     * the GtkTreeIters the views hold on to.
+     */
+    moving = g_sequence_new (NULL);
+    for (i = 0; i < n_moving; ++i)
+    {
+        g_sequence_move (image_iters[i], g_sequence_get_end_iter (moving));
+    }
+    for (i = 0; i < n_moving; ++i)
+    {
+        g_sequence_move (
+                image_iters[i],
+                g_sequence_search (
+                        images,
+                        g_sequence_get (image_iters[i]),
+                        cb_rstto_image_list_sequence_compare_func,
+                        image_list));
+    }
+    g_sequence_free (moving);
+
+    /* new_order maps every new position to the old one. The
+     * pending files are placed first, the others fill the gaps
+     * in the order they had.
+     */
+    n_images = g_sequence_get_length (images);
+    new_order = g_new (gint, n_images);
+    for (pos = 0; pos < n_images; ++pos)
+    {
+        new_order[pos] = -1;
+    }
+    for (i = 0; i < n_moving; ++i)
+    {
+        new_order[g_sequence_iter_get_position (image_iters[i])] = old_positions[i];
+    }
+
+    g_qsort_with_data (
+            old_positions,
+            n_moving,
+            sizeof (gint),
+            cb_rstto_image_list_int_compare_func,
+            NULL);
+
+    old_pos = 0;
+    j = 0;
+    for (pos = 0; pos < n_images; ++pos)
+    {
+        if (-1 == new_order[pos])
+        {
+            while (j < n_moving && old_positions[j] == old_pos)
+            {
+                ++old_pos;
+                ++j;
+            }
+            new_order[pos] = old_pos++;
+        }
+        if (new_order[pos] != pos)
+        {
+            reordered = TRUE;
+        }
+    }
+
+    g_hash_table_remove_all (image_list->priv->resort_pending);
+
+    if (TRUE == reordered)
+    {
+        path = gtk_tree_path_new ();
+        gtk_tree_model_rows_reordered (GTK_TREE_MODEL (image_list), path, NULL, new_order);
+        gtk_tree_path_free (path);
+    }
+
+    g_free (new_order);
+    g_free (old_positions);
+    g_free (image_iters);
+}
+
+static gboolean
+cb_rstto_image_list_resort_timeout (gpointer user_data)
+{
+    RsttoImageList *image_list = RSTTO_IMAGE_LIST (user_data);
+
+    image_list->priv->resort_timeout_id = 0;
+
+    rstto_image_list_resort_pending (image_list);
+
+    return FALSE;
+}
+
 gboolean
 rstto_image_list_is_busy (
         RsttoImageList *list )
 {
-    if (list->priv->directory_loader == 0)
+    if (list->priv->directory_loader == NULL)
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * rstto_image_list_get_progress:
+ * @list:
+ * @n_scanned: Return location for the number of directory entries scanned
+ * @n_estimated: Return location for the estimated number of entries,
+ *               0 if it is unknown
+ *
+ * Return value: TRUE if a directory is being loaded
+ */
+gboolean
+rstto_image_list_get_progress (
+        RsttoImageList *list,
+        guint *n_scanned,
+        guint *n_estimated )
+{
+    RsttoFileLoader *loader = list->priv->directory_loader;
+
+    if (loader == NULL)
     {
         return FALSE;
     }
 
+    if (n_scanned)
+    {
+        *n_scanned = g_atomic_int_get (&loader->n_scanned);
+    }
+    if (n_estimated)
+    {
+        *n_estimated = g_atomic_int_get (&loader->n_estimated);
+    }
+
     return TRUE;
 }
@@ -123,6 +123,12 @@ gboolean
 rstto_image_list_is_busy (
         RsttoImageList *list );
 
+gboolean
+rstto_image_list_get_progress (
+        RsttoImageList *list,
+        guint *n_scanned,
+        guint *n_estimated );
+
 
 GCompareFunc
 rstto_image_list_get_compare_func (
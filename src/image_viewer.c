@@ -20,17 +20,14 @@
 #include <gio/gio.h>
 
 #include <math.h>
+#include <string.h>
 
 #include "util.h"
 #include "image_viewer.h"
 #include "settings.h"
-
-/* Do not make this buffer too large,
- * this breaks some pixbufloaders.
- */
-#ifndef RSTTO_IMAGE_VIEWER_BUFFER_SIZE
-#define RSTTO_IMAGE_VIEWER_BUFFER_SIZE 4096
-#endif
+#include "image_decoder.h"
+#include "image_cache.h"
+#include "metadata_reader.h"
 
 #ifndef BACKGROUND_ICON_NAME
 #define BACKGROUND_ICON_NAME "org.xfce.ristretto"
@@ -44,6 +41,81 @@
 #define RSTTO_MAX_SCALE 4.0
 #endif
 
+/* The smallest mipmap-level that is built */
+#ifndef RSTTO_IMAGE_VIEWER_MIPMAP_MIN_SIZE
+#define RSTTO_IMAGE_VIEWER_MIPMAP_MIN_SIZE 64
+#endif
+
+/* Width and height of the tiles the image is painted in */
+#ifndef RSTTO_IMAGE_VIEWER_TILE_SIZE
+#define RSTTO_IMAGE_VIEWER_TILE_SIZE 256
+#endif
+
+/* Memory used by tiles before the least recently
+ * painted ones are dropped, in bytes.
+ */
+#ifndef RSTTO_IMAGE_VIEWER_TILE_CACHE_SIZE
+#define RSTTO_IMAGE_VIEWER_TILE_CACHE_SIZE (128 * 1024 * 1024)
+#endif
+
+/* Number of animation-frames that are composited
+ * ahead of the one that is displayed.
+ */
+#ifndef RSTTO_IMAGE_VIEWER_FRAME_RING_SIZE
+#define RSTTO_IMAGE_VIEWER_FRAME_RING_SIZE 8
+#endif
+
+/* Memory the composited frames may use, in bytes. There
+ * are always at least two frames ahead, whatever their size.
+ */
+#ifndef RSTTO_IMAGE_VIEWER_FRAME_RING_BUDGET
+#define RSTTO_IMAGE_VIEWER_FRAME_RING_BUDGET (64 * 1024 * 1024)
+#endif
+
+/* Shorter frame-delays are stretched to this, in ms */
+#ifndef RSTTO_IMAGE_VIEWER_MIN_FRAME_DELAY
+#define RSTTO_IMAGE_VIEWER_MIN_FRAME_DELAY 20
+#endif
+
+/* Size of the squares of the checkered background */
+#ifndef RSTTO_IMAGE_VIEWER_CHECKER_SIZE
+#define RSTTO_IMAGE_VIEWER_CHECKER_SIZE 10
+#endif
+
+/* Time the viewer has to be idle before an image that was first
+ * decoded at the size of the viewer is decoded at full size, in ms.
+ */
+#ifndef RSTTO_IMAGE_VIEWER_REFINE_DELAY
+#define RSTTO_IMAGE_VIEWER_REFINE_DELAY 500
+#endif
+
+/* Time the image has to be left alone after it was zoomed,
+ * panned or resized before it is painted at full quality, in ms.
+ */
+#ifndef RSTTO_IMAGE_VIEWER_SETTLE_DELAY
+#define RSTTO_IMAGE_VIEWER_SETTLE_DELAY 150
+#endif
+
+/* Largest image that is resampled to the scale it is painted at,
+ * in pixels. Larger ones are painted from their mipmap.
+ */
+#ifndef RSTTO_IMAGE_VIEWER_RESAMPLE_MAX_PIXELS
+#define RSTTO_IMAGE_VIEWER_RESAMPLE_MAX_PIXELS (16 * 1024 * 1024)
+#endif
+
+/* Key of the resampled pixbuf in the tile-cache, next to the mipmap-levels */
+#define RSTTO_IMAGE_VIEWER_RESAMPLED_LEVEL 0xff
+
+/* Loaders that decode faster at a reduced size, instead of
+ * decoding at full size and scaling down afterwards.
+ * These are first decoded at the size of the viewer.
+ */
+static const gchar *rstto_image_viewer_scaled_decode[] =
+{
+    "image/jpeg",
+    NULL
+};
+
 enum
 {
     PROP_0,
@@ -63,12 +135,80 @@ typedef enum
     RSTTO_IMAGE_VIEWER_MOTION_STATE_MOVE
 } RsttoImageViewerMotionState;
 
+/* Overlays are painted on top of the image, in this order */
+typedef enum
+{
+    RSTTO_IMAGE_VIEWER_OVERLAY_SELECTION_BOX = 0,
+    RSTTO_IMAGE_VIEWER_OVERLAY_CLOCK,
+    RSTTO_IMAGE_VIEWER_OVERLAY_COUNT
+} RsttoImageViewerOverlayType;
+
 typedef struct _RsttoImageViewerTransaction RsttoImageViewerTransaction;
 
+typedef struct
+{
+    /* mipmap-level, row and column */
+    guint64          key;
+    cairo_surface_t *surface;
+
+    /* Link in the lru-queue, the head is painted most recently */
+    GList           *link;
+} RsttoImageViewerTile;
+
+typedef struct
+{
+    cairo_surface_t       *surface;
+
+    /* Time to show the frame in ms, -1 for the last frame */
+    gint                   delay;
+
+    /* Part of the frame that differs from the frame before it */
+    cairo_rectangle_int_t  damage;
+} RsttoImageViewerFrame;
+
+typedef struct
+{
+    /* Shared with the viewer, only one worker-thread uses it at a time */
+    GdkPixbufAnimationIter *iter;
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+    GTimeVal                time;
+G_GNUC_END_IGNORE_DEPRECATIONS
+
+    /* The frame before the one that is composited */
+    cairo_surface_t        *last;
+} RsttoImageViewerComposite;
+
+typedef struct
+{
+    /* Mipmap-level the pixbuf is resampled from */
+    GdkPixbuf *level;
+    gint       width;
+    gint       height;
+
+    /* Scale of the viewer it is resampled for */
+    gdouble    scale;
+} RsttoImageViewerResample;
+
+typedef struct
+{
+    /* Part of the window the overlay was last painted in,
+     * empty if it was not painted.
+     */
+    cairo_rectangle_int_t  rect;
+
+    /* The overlay as it was painted in rect, or NULL if
+     * it has to be painted again.
+     */
+    cairo_surface_t       *layer;
+} RsttoImageViewerOverlay;
+
 struct _RsttoImageViewerPriv
 {
     RsttoFile                   *file;
     RsttoSettings               *settings;
+    RsttoImageCache             *cache;
+    RsttoImageDecoder           *decoder;
+    RsttoMetadataReader         *metadata_reader;
 
     GtkIconTheme                *icon_theme;
     GdkPixbuf                   *missing_icon;
@@ -85,6 +225,57 @@ struct _RsttoImageViewerPriv
 
     RsttoImageViewerTransaction *transaction;
     GdkPixbuf                   *pixbuf;
+
+    /* Painted underneath images with an alpha-channel */
+    cairo_pattern_t             *checker;
+
+    /* Decodes the image at full size, after it was first
+     * decoded at the size of the viewer.
+     */
+    RsttoImageViewerTransaction *refinement;
+    guint                        refine_timeout_id;
+
+    /* Downscaled copies of the pixbuf, built in a worker-thread the
+     * first time it is painted at less than half its size. Level n
+     * is 1/2^n the size of the pixbuf, and is stored at index n-1.
+     */
+    struct
+    {
+        GPtrArray    *pixbufs;
+        GCancellable *cancellable;
+    } mipmap;
+
+    /* While the image is zoomed, panned or resized it is painted
+     * with a fast filter. Once it is left alone, it is painted again
+     * at full quality, and a downscaled image is resampled to the
+     * exact scale it is painted at in a worker-thread.
+     */
+    struct
+    {
+        gboolean      interacting;
+        guint         timeout_id;
+
+        /* Part of the image was painted with the fast filter */
+        gboolean      fast;
+
+        GdkPixbuf    *pixbuf;
+        gdouble       scale;
+
+        /* Set while a pixbuf is resampled, for pending_scale */
+        GCancellable *cancellable;
+        gdouble       pending_scale;
+    } resample;
+
+    /* The pixbuf and its mipmap-levels are painted in tiles,
+     * which are converted to surfaces similar to the window
+     * the first time they are visible.
+     */
+    struct
+    {
+        GHashTable   *table;
+        GQueue       *lru;
+        gsize         size;
+    } tiles;
     RsttoImageOrientation        orientation;
     struct
     {
@@ -92,6 +283,12 @@ struct _RsttoImageViewerPriv
         gdouble y_offset;
         gdouble width;
         gdouble height;
+
+        /* Maps the pixels of the pixbuf to the window, set
+         * when the pixbuf itself is painted in tiles.
+         */
+        cairo_matrix_t matrix;
+        gboolean painted;
     } rendering;
 
     struct
@@ -105,11 +302,79 @@ struct _RsttoImageViewerPriv
     /* Animation data for animated images (like .gif/.mng) */
     /*******************************************************/
     GdkPixbufAnimation     *animation;
-    GdkPixbufAnimationIter *iter;
-    gint                    animation_timeout_id;
+
+    /* The frames are composited into surfaces ahead of time, in a
+     * worker-thread. A tick-callback on the frame-clock swaps them in.
+     */
+    struct
+    {
+        /* Runs ahead of the displayed frame, on animation-time */
+        GdkPixbufAnimationIter *iter;
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        GTimeVal                time;
+G_GNUC_END_IGNORE_DEPRECATIONS
+        gboolean                done;
+        cairo_surface_t        *last;
+
+        GQueue                 *ring;
+        RsttoImageViewerFrame  *current;
+
+        /* Frame-time at which the next frame is due */
+        gint64                  due;
+
+        /* Maps the frame to the window, set when it is painted */
+        cairo_matrix_t          matrix;
+        gboolean                painted;
+
+        /* Set while a frame is composited */
+        GCancellable           *cancellable;
+        guint                   tick_id;
+    } frames;
+
+    /* The background and the image, as they were last painted.
+     * Overlays like the clock are painted on top of it. When the
+     * image is panned, the surface is shifted and only the part
+     * that scrolled into view is painted again.
+     */
+    struct
+    {
+        cairo_surface_t        *surface;
+        cairo_surface_t        *spare;
+
+        /* Part of the surface that has to be painted again */
+        cairo_region_t         *dirty;
+
+        gint                    width;
+        gint                    height;
+
+        /* Adjustment-values the surface was painted at */
+        gdouble                 x;
+        gdouble                 y;
+
+        /* State the image was painted in, if any of
+         * it changes the surface is painted again.
+         */
+        gdouble                 scale;
+        gint                    image_width;
+        gint                    image_height;
+        RsttoImageOrientation   orientation;
+
+        /* Set while invalidating the window for a change
+         * that does not affect the surface.
+         */
+        gboolean                keep;
+    } backing;
+
+    RsttoImageViewerOverlay overlays[RSTTO_IMAGE_VIEWER_OVERLAY_COUNT];
 
     gint                    refresh_timeout_id;
 
+    /* Repaints the partially decoded image on the next frame */
+    guint                   progress_tick_id;
+
+    /* Part of the pixbuf that was decoded since it was painted */
+    GdkRectangle            progress_area;
+
     gdouble                 scale;
     gboolean                auto_scale;
 
@@ -139,7 +404,6 @@ struct _RsttoImageViewerTransaction
     RsttoImageViewer *viewer;
     RsttoFile        *file;
     GCancellable     *cancellable;
-    GdkPixbufLoader  *loader;
 
     GError           *error;
 
@@ -149,9 +413,22 @@ struct _RsttoImageViewerTransaction
     gdouble           scale;
     RsttoImageOrientation orientation;
 
-    /* File I/O data */
-    /*****************/
-    guchar           *buffer;
+    /* Size the image is limited to, 0 for no limit */
+    gint              max_width;
+    gint              max_height;
+
+    /* Size the image is limited to once it is refined,
+     * equal to max_width and max_height unless this
+     * is a first, viewport-sized decode.
+     */
+    gint              full_width;
+    gint              full_height;
+
+    /* Part of the image has been painted while it was decoded */
+    gboolean          progressive;
+
+    /* A thumbnail has been painted while the image is decoded */
+    gboolean          placeholder;
 };
 
 static void
@@ -187,6 +464,12 @@ static gboolean
 rstto_image_viewer_draw(GtkWidget *, cairo_t *);
 static void
 rstto_image_viewer_paint (GtkWidget *widget, cairo_t *);
+static void
+rstto_image_viewer_paint_scene (GtkWidget *widget, cairo_t *);
+static void
+cb_rstto_image_viewer_invalidate (GdkWindow *window, cairo_region_t *region);
+static void
+rstto_image_viewer_update_overlay (RsttoImageViewer *viewer, RsttoImageViewerOverlayType type);
 
 static void
 rstto_image_viewer_set_property (
@@ -216,17 +499,37 @@ static void
 cb_rstto_image_viewer_value_changed(GtkAdjustment *adjustment, RsttoImageViewer *viewer);
 
 static void
-cb_rstto_image_viewer_read_file_ready (GObject *source_object, GAsyncResult *result, gpointer user_data);
+cb_rstto_image_viewer_decode_ready (GObject *source_object, GAsyncResult *result, gpointer user_data);
+static void
+cb_rstto_image_viewer_decode_progress (
+        RsttoImageDecoder *decoder,
+        GdkPixbuf *pixbuf,
+        const GdkRectangle *area,
+        gint image_width,
+        gint image_height,
+        gdouble image_scale,
+        gpointer user_data);
+static gboolean
+cb_rstto_image_viewer_progress_tick (
+        GtkWidget *widget,
+        GdkFrameClock *frame_clock,
+        gpointer user_data);
 static void
-cb_rstto_image_viewer_read_input_stream_ready (GObject *source_object, GAsyncResult *result, gpointer user_data);
+rstto_image_viewer_stop_animation (
+        RsttoImageViewer *viewer);
 static void
-cb_rstto_image_loader_image_ready (GdkPixbufLoader *, RsttoImageViewerTransaction *);
+rstto_image_viewer_composite_next (
+        RsttoImageViewer *viewer);
 static void
-cb_rstto_image_loader_size_prepared (GdkPixbufLoader *, gint , gint , RsttoImageViewerTransaction *);
+cb_rstto_image_viewer_cache_ready (
+        RsttoImageCache *cache,
+        RsttoFile *r_file,
+        RsttoImageViewer *viewer);
 static void
-cb_rstto_image_loader_closed (GdkPixbufLoader *loader, RsttoImageViewerTransaction *transaction);
-static gboolean
-cb_rstto_image_viewer_update_pixbuf (gpointer user_data);
+cb_rstto_image_viewer_metadata_ready (
+        RsttoMetadataReader *reader,
+        RsttoFile *r_file,
+        RsttoImageViewer *viewer);
 static void
 cb_rstto_image_viewer_dnd (GtkWidget *widget, GdkDragContext *context, gint x, gint y, GtkSelectionData *data,
                            guint info, guint time_, RsttoImageViewer *viewer);
@@ -278,6 +581,55 @@ rstto_image_viewer_load_image (
         gdouble scale);
 static void
 rstto_image_viewer_transaction_free (RsttoImageViewerTransaction *tr);
+static void
+rstto_image_viewer_show_placeholder (
+        RsttoImageViewer *viewer,
+        RsttoImageViewerTransaction *transaction);
+static void
+rstto_image_viewer_refine (
+        RsttoImageViewer *viewer);
+static void
+rstto_image_viewer_cancel_refinement (
+        RsttoImageViewer *viewer);
+static void
+rstto_image_viewer_get_decode_size (
+        RsttoImageViewer *viewer,
+        gint *max_width,
+        gint *max_height);
+static void
+rstto_image_viewer_set_animation (
+        RsttoImageViewer *viewer,
+        GdkPixbufAnimation *animation);
+static void
+rstto_image_viewer_set_pixbuf (
+        RsttoImageViewer *viewer,
+        GdkPixbuf *pixbuf);
+static void
+rstto_image_viewer_clear_tiles (
+        RsttoImageViewer *viewer);
+static void
+rstto_image_viewer_tile_free (
+        RsttoImageViewerTile *tile);
+static GdkPixbuf *
+rstto_image_viewer_get_mipmap (
+        RsttoImageViewer *viewer,
+        gdouble scale,
+        guint *n,
+        gdouble *x_scale,
+        gdouble *y_scale);
+static void
+rstto_image_viewer_paint_tiles (
+        RsttoImageViewer *viewer,
+        cairo_t *ctx,
+        GdkPixbuf *level,
+        guint n,
+        cairo_filter_t filter);
+static GdkPixbuf *
+rstto_image_viewer_get_resampled (RsttoImageViewer *viewer);
+static void
+rstto_image_viewer_cancel_resample (RsttoImageViewer *viewer);
+static void
+rstto_image_viewer_interact (RsttoImageViewer *viewer);
 
 static GtkWidgetClass *parent_class = NULL;
 static GdkScreen      *default_screen = NULL;
@@ -297,6 +649,17 @@ rstto_image_viewer_init (RsttoImageViewer *viewer)
     viewer->priv = g_new0(RsttoImageViewerPriv, 1);
     viewer->priv->cb_value_changed = cb_rstto_image_viewer_value_changed;
     viewer->priv->settings = rstto_settings_new ();
+    viewer->priv->cache = rstto_image_cache_new ();
+    viewer->priv->decoder = rstto_image_decoder_new ();
+    viewer->priv->metadata_reader = rstto_metadata_reader_new ();
+    viewer->priv->tiles.table = g_hash_table_new_full (
+            g_int64_hash,
+            g_int64_equal,
+            NULL,
+            (GDestroyNotify) rstto_image_viewer_tile_free);
+    viewer->priv->tiles.lru = g_queue_new ();
+    viewer->priv->frames.ring = g_queue_new ();
+    viewer->priv->backing.dirty = cairo_region_create ();
     viewer->priv->image_width = 0;
     viewer->priv->image_height = 0;
 
@@ -343,6 +706,17 @@ rstto_image_viewer_init (RsttoImageViewer *viewer)
             "notify::invert-zoom-direction",
             G_CALLBACK (cb_rstto_zoom_direction_changed),
             viewer);
+    g_signal_connect (
+            G_OBJECT(viewer->priv->cache),
+            "ready",
+            G_CALLBACK (cb_rstto_image_viewer_cache_ready),
+            viewer);
+    g_signal_connect (
+            G_OBJECT(viewer->priv->metadata_reader),
+            "ready",
+            G_CALLBACK (cb_rstto_image_viewer_metadata_ready),
+            viewer);
+
     g_signal_connect (
             G_OBJECT(viewer),
             "drag-data-received",
@@ -506,6 +880,8 @@ rstto_image_viewer_realize(GtkWidget *widget)
     gdk_window_set_user_data (window, widget);
     g_object_ref (window);
 
+    gdk_window_set_invalidate_handler (window, cb_rstto_image_viewer_invalidate);
+
     g_object_get_property (
             G_OBJECT(viewer->priv->settings),
             "bgcolor",
@@ -577,6 +953,8 @@ rstto_image_viewer_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
     gtk_widget_set_allocation (widget, allocation);
     if (gtk_widget_get_realized (widget))
     {
+        rstto_image_viewer_interact (viewer);
+
         gdk_window_move_resize (window,
                 allocation->x + border_width,
                 allocation->y + border_width,
@@ -620,6 +998,7 @@ static void
 rstto_image_viewer_dispose (GObject *object)
 {
     RsttoImageViewer *viewer = RSTTO_IMAGE_VIEWER(object);
+    gint i;
 
     if (viewer->priv)
     {
@@ -628,6 +1007,37 @@ rstto_image_viewer_dispose (GObject *object)
             g_object_unref (viewer->priv->settings);
             viewer->priv->settings = NULL;
         }
+        if (viewer->priv->cache)
+        {
+            g_signal_handlers_disconnect_by_func (
+                    viewer->priv->cache,
+                    cb_rstto_image_viewer_cache_ready,
+                    viewer);
+            g_object_unref (viewer->priv->cache);
+            viewer->priv->cache = NULL;
+        }
+        if (viewer->priv->decoder)
+        {
+            g_object_unref (viewer->priv->decoder);
+            viewer->priv->decoder = NULL;
+        }
+        if (viewer->priv->metadata_reader)
+        {
+            g_signal_handlers_disconnect_by_func (
+                    viewer->priv->metadata_reader,
+                    cb_rstto_image_viewer_metadata_ready,
+                    viewer);
+            g_object_unref (viewer->priv->metadata_reader);
+            viewer->priv->metadata_reader = NULL;
+        }
+        rstto_image_viewer_cancel_refinement (viewer);
+        if (viewer->priv->progress_tick_id)
+        {
+            gtk_widget_remove_tick_callback (
+                    GTK_WIDGET (viewer),
+                    viewer->priv->progress_tick_id);
+            viewer->priv->progress_tick_id = 0;
+        }
         if (viewer->priv->bg_icon)
         {
             g_object_unref (viewer->priv->bg_icon);
@@ -638,15 +1048,33 @@ rstto_image_viewer_dispose (GObject *object)
             g_object_unref (viewer->priv->missing_icon);
             viewer->priv->missing_icon = NULL;
         }
-        if (viewer->priv->pixbuf)
+        rstto_image_viewer_set_animation (viewer, NULL);
+        if (viewer->priv->resample.timeout_id)
+        {
+            REMOVE_SOURCE (viewer->priv->resample.timeout_id);
+        }
+        g_hash_table_destroy (viewer->priv->tiles.table);
+        g_queue_free (viewer->priv->tiles.lru);
+        g_queue_free (viewer->priv->frames.ring);
+        if (viewer->priv->backing.surface)
+        {
+            cairo_surface_destroy (viewer->priv->backing.surface);
+        }
+        if (viewer->priv->backing.spare)
+        {
+            cairo_surface_destroy (viewer->priv->backing.spare);
+        }
+        cairo_region_destroy (viewer->priv->backing.dirty);
+        if (viewer->priv->checker)
         {
-            g_object_unref (viewer->priv->pixbuf);
-            viewer->priv->pixbuf = NULL;
+            cairo_pattern_destroy (viewer->priv->checker);
         }
-        if (viewer->priv->iter)
+        for (i = 0; i < RSTTO_IMAGE_VIEWER_OVERLAY_COUNT; ++i)
         {
-            g_object_unref (viewer->priv->iter);
-            viewer->priv->iter = NULL;
+            if (viewer->priv->overlays[i].layer)
+            {
+                cairo_surface_destroy (viewer->priv->overlays[i].layer);
+            }
         }
         g_free (viewer->priv);
         viewer->priv = NULL;
@@ -841,6 +1269,16 @@ set_scale (RsttoImageViewer *viewer, gdouble scale )
 
     viewer->priv->auto_scale = auto_scale;
     viewer->priv->scale = scale;
+
+    /* Zoomed in beyond the detail of the first decode,
+     * there is no need to wait for the viewer to be idle.
+     */
+    if (viewer->priv->refine_timeout_id && scale > viewer->priv->image_scale)
+    {
+        REMOVE_SOURCE (viewer->priv->refine_timeout_id);
+        rstto_image_viewer_refine (viewer);
+    }
+
     g_signal_emit_by_name(viewer, "scale-changed");
 }
  
@@ -1049,6 +1487,42 @@ correct_adjustments (RsttoImageViewer *viewer)
     g_object_thaw_notify(G_OBJECT(viewer->vadjustment));
 }
 
+/**
+ * rstto_image_viewer_get_clock_rect:
+ * @viewer:
+ * @rect: (out): The part of the window the clock covers
+ *
+ * Return value: TRUE if the clock is shown.
+ */
+static gboolean
+rstto_image_viewer_get_clock_rect (RsttoImageViewer *viewer, cairo_rectangle_int_t *rect)
+{
+    gdouble width;
+    gdouble offset;
+    GtkAllocation allocation;
+
+    if (FALSE == viewer->priv->props.show_clock)
+    {
+        return FALSE;
+    }
+
+    gtk_widget_get_allocation (GTK_WIDGET (viewer), &allocation);
+
+    /* Same geometry as paint_clock */
+    width = (allocation.width < allocation.height)
+            ? 40 + ((gdouble)allocation.width * 0.07)
+            : 40 + ((gdouble)allocation.height * 0.07);
+    offset = width * 0.15;
+
+    /* Leave a pixel for the anti-aliasing */
+    rect->x = (gint)floor (allocation.width - offset - width) - 1;
+    rect->y = (gint)floor (allocation.height - offset - width) - 1;
+    rect->width = (gint)ceil (allocation.width - offset) + 1 - rect->x;
+    rect->height = (gint)ceil (allocation.height - offset) + 1 - rect->y;
+
+    return TRUE;
+}
+
 static void
 paint_clock (GtkWidget *widget, cairo_t *ctx)
 {
@@ -1143,19 +1617,69 @@ paint_clock (GtkWidget *widget, cairo_t *ctx)
     cairo_restore (ctx);
 }
 
+/**
+ * rstto_image_viewer_get_checker:
+ * @viewer:
+ *
+ * Return value: A repeating pattern of light and dark squares, painted
+ *               underneath images with an alpha-channel.
+ */
+static cairo_pattern_t *
+rstto_image_viewer_get_checker (RsttoImageViewer *viewer)
+{
+    cairo_surface_t *surface;
+    cairo_t         *ctx;
+
+    if (NULL == viewer->priv->checker)
+    {
+        surface = gdk_window_create_similar_surface (
+                gtk_widget_get_window (GTK_WIDGET (viewer)),
+                CAIRO_CONTENT_COLOR,
+                RSTTO_IMAGE_VIEWER_CHECKER_SIZE * 2,
+                RSTTO_IMAGE_VIEWER_CHECKER_SIZE * 2);
+
+        ctx = cairo_create (surface);
+        cairo_set_source_rgb (ctx, 0.8, 0.8, 0.8);
+        cairo_paint (ctx);
+
+        cairo_set_source_rgb (ctx, 0.7, 0.7, 0.7);
+        cairo_rectangle (
+                ctx,
+                0,
+                0,
+                RSTTO_IMAGE_VIEWER_CHECKER_SIZE,
+                RSTTO_IMAGE_VIEWER_CHECKER_SIZE);
+        cairo_rectangle (
+                ctx,
+                RSTTO_IMAGE_VIEWER_CHECKER_SIZE,
+                RSTTO_IMAGE_VIEWER_CHECKER_SIZE,
+                RSTTO_IMAGE_VIEWER_CHECKER_SIZE,
+                RSTTO_IMAGE_VIEWER_CHECKER_SIZE);
+        cairo_fill (ctx);
+        cairo_destroy (ctx);
+
+        viewer->priv->checker = cairo_pattern_create_for_surface (surface);
+        cairo_pattern_set_extend (viewer->priv->checker, CAIRO_EXTEND_REPEAT);
+        cairo_pattern_set_filter (viewer->priv->checker, CAIRO_FILTER_NEAREST);
+        cairo_surface_destroy (surface);
+    }
+
+    return viewer->priv->checker;
+}
+
 static void
 paint_image (GtkWidget *widget, cairo_t *ctx)
 {
     RsttoImageViewer *viewer = RSTTO_IMAGE_VIEWER (widget);
-    gint i = 0;
-    gint a = 0;
     gdouble x_offset;
     gdouble y_offset;
-    gint block_width = 10;
-    gint block_height = 10;
     gdouble bg_scale = 1.0;
     GtkAllocation allocation;
     cairo_matrix_t transform_matrix;
+    GdkPixbuf *level;
+    guint n;
+    gdouble x_scale, y_scale;
+    cairo_filter_t filter;
 
     gtk_widget_get_allocation (widget, &allocation);
 
@@ -1213,48 +1737,22 @@ paint_image (GtkWidget *widget, cairo_t *ctx)
 /* BEGIN PAINT CHECKERED BACKGROUND */
         if (TRUE == gdk_pixbuf_get_has_alpha (viewer->priv->pixbuf))
         {
-            cairo_set_source_rgba (ctx, 0.8, 0.8, 0.8, 1.0);
             cairo_rectangle (
                     ctx,
                     x_offset,
                     y_offset,
                     viewer->priv->rendering.width,
                     viewer->priv->rendering.height);
-            cairo_fill (ctx);
-
-            cairo_set_source_rgba (ctx, 0.7, 0.7, 0.7, 1.0);
-            for (i = 0; i < viewer->priv->rendering.width/10; ++i)
-            {
-                if(i%2){a=1;}
-                else{a=0;}
 
-                if ((i+1) <= (viewer->priv->rendering.width/10))
-                {
-                    block_width = 10;
-                }
-                else
-                {
-                    block_width = ((gint)viewer->priv->rendering.width)%10;
-                }
-                for (; a < viewer->priv->rendering.height/10; a+=2)
-                {
-                    if ((a+1) <= (viewer->priv->rendering.height/10))
-                    {
-                        block_height = 10;
-                    }
-                    else
-                    {
-                        block_height = ((gint)viewer->priv->rendering.height%10);
-                    }
-                    cairo_rectangle (
-                            ctx,
-                            x_offset + i*10,
-                            y_offset + a*10,
-                            block_width,
-                            block_height);
-                    cairo_fill (ctx);
-                }
-            }
+            /* Keep the checkers in place on the image when it is
+             * panned, the backing-surface is shifted along with it.
+             */
+            cairo_translate (
+                    ctx,
+                    x_offset - floor (gtk_adjustment_get_value (viewer->hadjustment)),
+                    y_offset - floor (gtk_adjustment_get_value (viewer->vadjustment)));
+            cairo_set_source (ctx, rstto_image_viewer_get_checker (viewer));
+            cairo_fill (ctx);
         }
 /* END PAINT CHECKERED BACKGROUND */
         cairo_restore (ctx);
@@ -1395,17 +1893,66 @@ paint_image (GtkWidget *widget, cairo_t *ctx)
 
         }
 
-        cairo_scale (
-                ctx,
-                (viewer->priv->scale/viewer->priv->image_scale),
-                (viewer->priv->scale/viewer->priv->image_scale));
+        if (NULL != viewer->priv->frames.current)
+        {
+            cairo_scale (
+                    ctx,
+                    (viewer->priv->scale/viewer->priv->image_scale),
+                    (viewer->priv->scale/viewer->priv->image_scale));
 
-        gdk_cairo_set_source_pixbuf (
-                ctx,
-                viewer->priv->pixbuf,
-                0.0,
-                0.0);
-        cairo_paint (ctx);
+            /* The next frame only invalidates what it changes */
+            cairo_get_matrix (ctx, &viewer->priv->frames.matrix);
+            viewer->priv->frames.painted = TRUE;
+            viewer->priv->rendering.painted = FALSE;
+
+            cairo_set_source_surface (
+                    ctx,
+                    viewer->priv->frames.current->surface,
+                    0.0,
+                    0.0);
+            cairo_paint (ctx);
+        }
+        else if (NULL != (level = rstto_image_viewer_get_resampled (viewer)))
+        {
+            viewer->priv->rendering.painted = FALSE;
+
+            /* Resampled to the size it is painted at */
+            rstto_image_viewer_paint_tiles (
+                    viewer,
+                    ctx,
+                    level,
+                    RSTTO_IMAGE_VIEWER_RESAMPLED_LEVEL,
+                    CAIRO_FILTER_NEAREST);
+        }
+        else
+        {
+            /* Paint the smallest mipmap-level that still has enough detail */
+            level = rstto_image_viewer_get_mipmap (
+                    viewer,
+                    viewer->priv->scale/viewer->priv->image_scale,
+                    &n,
+                    &x_scale,
+                    &y_scale);
+
+            cairo_scale (
+                    ctx,
+                    (viewer->priv->scale/viewer->priv->image_scale) * x_scale,
+                    (viewer->priv->scale/viewer->priv->image_scale) * y_scale);
+
+            /* Partial updates of the pixbuf only invalidate what they change */
+            cairo_get_matrix (ctx, &viewer->priv->rendering.matrix);
+            viewer->priv->rendering.painted = (0 == n);
+
+            filter = CAIRO_FILTER_GOOD;
+            if (viewer->priv->resample.interacting &&
+                (viewer->priv->scale/viewer->priv->image_scale) * x_scale != 1.0)
+            {
+                filter = CAIRO_FILTER_FAST;
+                viewer->priv->resample.fast = TRUE;
+            }
+
+            rstto_image_viewer_paint_tiles (viewer, ctx, level, n, filter);
+        }
     }
     else
     {
@@ -1450,10 +1997,26 @@ paint_image (GtkWidget *widget, cairo_t *ctx)
 
 }
 
-static void
-paint_selection_box (GtkWidget *widget, cairo_t *ctx )
+/**
+ * rstto_image_viewer_get_selection_box:
+ * @viewer:
+ * @x: (out):
+ * @y: (out):
+ * @width: (out):
+ * @height: (out):
+ *
+ * Calculate the selection-box, constrained to the image.
+ *
+ * Return value: FALSE if nothing of the box is on the image.
+ */
+static gboolean
+rstto_image_viewer_get_selection_box (
+        RsttoImageViewer *viewer,
+        gdouble *x,
+        gdouble *y,
+        gdouble *width,
+        gdouble *height)
 {
-    RsttoImageViewer *viewer = RSTTO_IMAGE_VIEWER (widget);
     gdouble box_y = 0.0;
     gdouble box_x = 0.0;
     gdouble box_width = 0.0;
@@ -1525,12 +2088,64 @@ paint_selection_box (GtkWidget *widget, cairo_t *ctx )
     if (box_width < 0.0)
     {
         /* Return, do not draw the box.  */
-        return;
+        return FALSE;
     }
     /* Same as above, for the vertical dimensions this time */
     if (box_height < 0.0)
     {
         /* Return, do not draw the box.  */
+        return FALSE;
+    }
+
+    *x = box_x;
+    *y = box_y;
+    *width = box_width;
+    *height = box_height;
+
+    return TRUE;
+}
+
+/**
+ * rstto_image_viewer_get_selection_box_rect:
+ * @viewer:
+ * @rect: (out): The part of the window the selection-box covers
+ *
+ * Return value: TRUE if the selection-box is shown.
+ */
+static gboolean
+rstto_image_viewer_get_selection_box_rect (RsttoImageViewer *viewer, cairo_rectangle_int_t *rect)
+{
+    gdouble box_x, box_y, box_width, box_height;
+
+    if (NULL == viewer->priv->file ||
+        viewer->priv->motion.state != RSTTO_IMAGE_VIEWER_MOTION_STATE_BOX_ZOOM ||
+        FALSE == rstto_image_viewer_get_selection_box (
+                viewer, &box_x, &box_y, &box_width, &box_height))
+    {
+        return FALSE;
+    }
+
+    /* The outline is stroked half a pixel off the box, one pixel wide */
+    rect->x = (gint)floor (box_x) - 1;
+    rect->y = (gint)floor (box_y) - 1;
+    rect->width = (gint)ceil (box_x + box_width) + 3 - rect->x;
+    rect->height = (gint)ceil (box_y + box_height) + 3 - rect->y;
+
+    return TRUE;
+}
+
+static void
+paint_selection_box (GtkWidget *widget, cairo_t *ctx )
+{
+    RsttoImageViewer *viewer = RSTTO_IMAGE_VIEWER (widget);
+    gdouble box_y = 0.0;
+    gdouble box_x = 0.0;
+    gdouble box_width = 0.0;
+    gdouble box_height = 0.0;
+
+    if (FALSE == rstto_image_viewer_get_selection_box (
+                viewer, &box_x, &box_y, &box_width, &box_height))
+    {
         return;
     }
 
@@ -1546,6 +2161,328 @@ paint_selection_box (GtkWidget *widget, cairo_t *ctx )
     cairo_stroke (ctx);
 }
 
+/* How each type of overlay is measured and painted, in
+ * the order of RsttoImageViewerOverlayType.
+ */
+static const struct
+{
+    gboolean (*get_rect) (RsttoImageViewer *viewer, cairo_rectangle_int_t *rect);
+    void     (*paint)    (GtkWidget *widget, cairo_t *ctx);
+} rstto_image_viewer_overlay_funcs[RSTTO_IMAGE_VIEWER_OVERLAY_COUNT] =
+{
+    { rstto_image_viewer_get_selection_box_rect, paint_selection_box },
+    { rstto_image_viewer_get_clock_rect, paint_clock }
+};
+
+/**
+ * rstto_image_viewer_paint_overlays:
+ * @widget:
+ * @ctx: Context of the window
+ *
+ * Paint the overlays that are shown, from the layers they
+ * were last rendered into if they did not change.
+ */
+static void
+rstto_image_viewer_paint_overlays (GtkWidget *widget, cairo_t *ctx)
+{
+    RsttoImageViewer *viewer = RSTTO_IMAGE_VIEWER (widget);
+    RsttoImageViewerOverlay *overlay;
+    cairo_rectangle_int_t rect;
+    cairo_t *layer_ctx;
+    gint i;
+
+    for (i = 0; i < RSTTO_IMAGE_VIEWER_OVERLAY_COUNT; ++i)
+    {
+        overlay = &viewer->priv->overlays[i];
+
+        if (FALSE == rstto_image_viewer_overlay_funcs[i].get_rect (viewer, &rect))
+        {
+            g_clear_pointer (&overlay->layer, cairo_surface_destroy);
+            overlay->rect.width = 0;
+            overlay->rect.height = 0;
+            continue;
+        }
+
+        if (NULL == overlay->layer ||
+            rect.x != overlay->rect.x ||
+            rect.y != overlay->rect.y ||
+            rect.width != overlay->rect.width ||
+            rect.height != overlay->rect.height)
+        {
+            g_clear_pointer (&overlay->layer, cairo_surface_destroy);
+            overlay->layer = gdk_window_create_similar_surface (
+                    gtk_widget_get_window (widget),
+                    CAIRO_CONTENT_COLOR_ALPHA,
+                    rect.width,
+                    rect.height);
+            overlay->rect = rect;
+
+            layer_ctx = cairo_create (overlay->layer);
+            cairo_translate (layer_ctx, -rect.x, -rect.y);
+            rstto_image_viewer_overlay_funcs[i].paint (widget, layer_ctx);
+            cairo_destroy (layer_ctx);
+        }
+
+        cairo_set_source_surface (ctx, overlay->layer, rect.x, rect.y);
+        cairo_paint (ctx);
+    }
+}
+
+/**
+ * rstto_image_viewer_update_overlay:
+ * @viewer:
+ * @type: The overlay that changed
+ *
+ * Render the overlay again, and invalidate the part of the
+ * window it was painted in and the part it will be painted
+ * in. The image underneath is not painted again.
+ */
+static void
+rstto_image_viewer_update_overlay (RsttoImageViewer *viewer, RsttoImageViewerOverlayType type)
+{
+    RsttoImageViewerOverlay *overlay = &viewer->priv->overlays[type];
+    cairo_rectangle_int_t rect;
+    cairo_region_t *region;
+
+    g_clear_pointer (&overlay->layer, cairo_surface_destroy);
+
+    if (FALSE == gtk_widget_get_realized (GTK_WIDGET (viewer)))
+    {
+        return;
+    }
+
+    region = cairo_region_create_rectangle (&overlay->rect);
+    if (rstto_image_viewer_overlay_funcs[type].get_rect (viewer, &rect))
+    {
+        cairo_region_union_rectangle (region, &rect);
+    }
+
+    viewer->priv->backing.keep = TRUE;
+    gdk_window_invalidate_region (
+            gtk_widget_get_window (GTK_WIDGET (viewer)),
+            region,
+            FALSE);
+    viewer->priv->backing.keep = FALSE;
+
+    cairo_region_destroy (region);
+}
+
+/**
+ * rstto_image_viewer_paint_scene:
+ * @widget:
+ * @ctx: Context of the backing-surface
+ *
+ * Paint the background, and the image or the background-icon.
+ */
+static void
+rstto_image_viewer_paint_scene (GtkWidget *widget, cairo_t *ctx)
+{
+    RsttoImageViewer *viewer = RSTTO_IMAGE_VIEWER (widget);
+
+    cairo_save (ctx);
+
+    /* Paint the background-color */
+    /******************************/
+    paint_background (widget, ctx);        
+
+    cairo_restore (ctx);
+
+    /* Check if a file should be rendered */
+    /**************************************/
+    if ( NULL == viewer->priv->file )
+    {
+        cairo_save (ctx);
+
+        /* Paint the background-image (ristretto icon) */
+        /***********************************************/
+        paint_background_icon (widget, ctx);        
+
+        cairo_restore (ctx);
+    }
+    else
+    {
+        cairo_save (ctx);
+        paint_image (widget, ctx);        
+        cairo_restore (ctx);
+    }
+}
+
+/**
+ * rstto_image_viewer_scroll_backing:
+ * @viewer:
+ * @dx: Horizontal distance to shift the backing-surface
+ * @dy: Vertical distance to shift the backing-surface
+ *
+ * Shift what was painted on the backing-surface, and mark the
+ * strips that are uncovered as dirty.
+ */
+static void
+rstto_image_viewer_scroll_backing (
+        RsttoImageViewer *viewer,
+        gint dx,
+        gint dy)
+{
+    cairo_surface_t *surface = viewer->priv->backing.surface;
+    cairo_region_t *exposed;
+    cairo_rectangle_int_t rect;
+    cairo_t *ctx;
+
+    rect.x = 0;
+    rect.y = 0;
+    rect.width = gtk_widget_get_allocated_width (GTK_WIDGET (viewer));
+    rect.height = gtk_widget_get_allocated_height (GTK_WIDGET (viewer));
+
+    if (NULL == viewer->priv->backing.spare)
+    {
+        viewer->priv->backing.spare = cairo_surface_create_similar (
+                surface,
+                CAIRO_CONTENT_COLOR_ALPHA,
+                rect.width,
+                rect.height);
+    }
+
+    /* Copying onto the spare surface, instead of onto itself,
+     * keeps the rows from overlapping.
+     */
+    ctx = cairo_create (viewer->priv->backing.spare);
+    cairo_set_operator (ctx, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface (ctx, surface, dx, dy);
+    cairo_paint (ctx);
+    cairo_destroy (ctx);
+
+    viewer->priv->backing.surface = viewer->priv->backing.spare;
+    viewer->priv->backing.spare = surface;
+
+    cairo_region_translate (viewer->priv->backing.dirty, dx, dy);
+
+    exposed = cairo_region_create_rectangle (&rect);
+    rect.x = dx;
+    rect.y = dy;
+    cairo_region_subtract_rectangle (exposed, &rect);
+    cairo_region_union (viewer->priv->backing.dirty, exposed);
+    cairo_region_destroy (exposed);
+}
+
+/**
+ * rstto_image_viewer_dirty_backing:
+ * @viewer:
+ *
+ * Mark all of the backing-surface as dirty.
+ */
+static void
+rstto_image_viewer_dirty_backing (RsttoImageViewer *viewer)
+{
+    cairo_rectangle_int_t rect;
+
+    rect.x = 0;
+    rect.y = 0;
+    rect.width = gtk_widget_get_allocated_width (GTK_WIDGET (viewer));
+    rect.height = gtk_widget_get_allocated_height (GTK_WIDGET (viewer));
+
+    cairo_region_union_rectangle (viewer->priv->backing.dirty, &rect);
+}
+
+/**
+ * rstto_image_viewer_update_backing:
+ * @viewer:
+ *
+ * Bring the backing-surface up to date with the adjustments,
+ * and paint the part of it that is dirty.
+ */
+static void
+rstto_image_viewer_update_backing (RsttoImageViewer *viewer)
+{
+    GtkWidget *widget = GTK_WIDGET (viewer);
+    gint width = gtk_widget_get_allocated_width (widget);
+    gint height = gtk_widget_get_allocated_height (widget);
+    gdouble x = 0.0;
+    gdouble y = 0.0;
+    cairo_t *ctx;
+
+    if (viewer->hadjustment && viewer->vadjustment)
+    {
+        x = gtk_adjustment_get_value (viewer->hadjustment);
+        y = gtk_adjustment_get_value (viewer->vadjustment);
+    }
+
+    if (NULL == viewer->priv->backing.surface ||
+        width != viewer->priv->backing.width ||
+        height != viewer->priv->backing.height)
+    {
+        if (viewer->priv->backing.surface)
+        {
+            cairo_surface_destroy (viewer->priv->backing.surface);
+        }
+        if (viewer->priv->backing.spare)
+        {
+            cairo_surface_destroy (viewer->priv->backing.spare);
+            viewer->priv->backing.spare = NULL;
+        }
+        viewer->priv->backing.surface = gdk_window_create_similar_surface (
+                gtk_widget_get_window (widget),
+                CAIRO_CONTENT_COLOR_ALPHA,
+                width,
+                height);
+        viewer->priv->backing.width = width;
+        viewer->priv->backing.height = height;
+
+        rstto_image_viewer_dirty_backing (viewer);
+    }
+    else if (viewer->priv->backing.scale != viewer->priv->scale ||
+             viewer->priv->backing.image_width != viewer->priv->image_width ||
+             viewer->priv->backing.image_height != viewer->priv->image_height ||
+             viewer->priv->backing.orientation != viewer->priv->orientation)
+    {
+        rstto_image_viewer_dirty_backing (viewer);
+    }
+    else if (x != viewer->priv->backing.x || y != viewer->priv->backing.y)
+    {
+        /* paint_image floors the adjustment-values, rounding
+         * them up or down depending on the orientation. Shifting
+         * by the difference is only exact if the fractions match.
+         */
+        if ((x - floor (x)) == (viewer->priv->backing.x - floor (viewer->priv->backing.x)) &&
+            (y - floor (y)) == (viewer->priv->backing.y - floor (viewer->priv->backing.y)))
+        {
+            rstto_image_viewer_scroll_backing (
+                    viewer,
+                    (gint)(floor (viewer->priv->backing.x) - floor (x)),
+                    (gint)(floor (viewer->priv->backing.y) - floor (y)));
+        }
+        else
+        {
+            rstto_image_viewer_dirty_backing (viewer);
+        }
+    }
+
+    viewer->priv->backing.x = x;
+    viewer->priv->backing.y = y;
+    viewer->priv->backing.scale = viewer->priv->scale;
+    viewer->priv->backing.image_width = viewer->priv->image_width;
+    viewer->priv->backing.image_height = viewer->priv->image_height;
+    viewer->priv->backing.orientation = viewer->priv->orientation;
+
+    if (cairo_region_is_empty (viewer->priv->backing.dirty))
+    {
+        return;
+    }
+
+    ctx = cairo_create (viewer->priv->backing.surface);
+    gdk_cairo_region (ctx, viewer->priv->backing.dirty);
+    cairo_clip (ctx);
+
+    cairo_set_operator (ctx, CAIRO_OPERATOR_CLEAR);
+    cairo_paint (ctx);
+    cairo_set_operator (ctx, CAIRO_OPERATOR_OVER);
+
+    rstto_image_viewer_paint_scene (widget, ctx);
+
+    cairo_destroy (ctx);
+
+    cairo_region_destroy (viewer->priv->backing.dirty);
+    viewer->priv->backing.dirty = cairo_region_create ();
+}
+
 static void
 rstto_image_viewer_paint (GtkWidget *widget, cairo_t *ctx)
 {
@@ -1555,6 +2492,10 @@ rstto_image_viewer_paint (GtkWidget *widget, cairo_t *ctx)
     {
         correct_adjustments (viewer);
 
+        /* Paint the background and the image */
+        /***************************************/
+        rstto_image_viewer_update_backing (viewer);
+
         cairo_rectangle (
                 ctx,
                 0.0,
@@ -1562,56 +2503,21 @@ rstto_image_viewer_paint (GtkWidget *widget, cairo_t *ctx)
                 (gdouble)gtk_widget_get_allocated_width (widget),
                 (gdouble)gtk_widget_get_allocated_height (widget));
         cairo_clip (ctx);
-        cairo_save (ctx);
-        
-        /* Paint the background-color */
-        /******************************/
-        paint_background (widget, ctx);        
 
+        cairo_save (ctx);
+        cairo_set_source_surface (ctx, viewer->priv->backing.surface, 0.0, 0.0);
+        cairo_paint (ctx);
         cairo_restore (ctx);
 
-        /* Check if a file should be rendered */
-        /**************************************/
-        if ( NULL == viewer->priv->file )
-        {
-            cairo_save (ctx);
-            
-            /* Paint the background-image (ristretto icon) */
-            /***********************************************/
-            paint_background_icon (widget, ctx);        
-
-            cairo_restore (ctx);
-
-            if (viewer->priv->props.show_clock)
-            {
-                cairo_save (ctx);
-                paint_clock (widget, ctx);        
-                cairo_restore (ctx);
-            }
-        }
-        else
-        {
-            cairo_save (ctx);
-            paint_image (widget, ctx);        
-            cairo_restore (ctx);
-
-            if (viewer->priv->motion.state == RSTTO_IMAGE_VIEWER_MOTION_STATE_BOX_ZOOM)
-            {
-                cairo_save (ctx);
-                paint_selection_box (widget, ctx);        
-                cairo_restore (ctx);
-            }
-
-            if (viewer->priv->props.show_clock)
-            {
-                cairo_save (ctx);
-                paint_clock (widget, ctx);        
-                cairo_restore (ctx);
-            }
-        }
+        /* Paint the overlays */
+        /**********************/
+        cairo_save (ctx);
+        rstto_image_viewer_paint_overlays (widget, ctx);
+        cairo_restore (ctx);
     }
 }
 
+
 GtkWidget *
 rstto_image_viewer_new (void)
 {
@@ -1712,21 +2618,7 @@ rstto_image_viewer_set_file (RsttoImageViewer *viewer, RsttoFile *file, gdouble
     } 
     else
     {
-        if (viewer->priv->iter)
-        {
-            g_object_unref (viewer->priv->iter);
-            viewer->priv->iter = NULL;
-        }
-        if (viewer->priv->animation)
-        {
-            g_object_unref (viewer->priv->animation);
-            viewer->priv->animation = NULL;
-        }
-        if (viewer->priv->pixbuf)
-        {
-            g_object_unref (viewer->priv->pixbuf);
-            viewer->priv->pixbuf = NULL;
-        }
+        rstto_image_viewer_set_animation (viewer, NULL);
         if (viewer->priv->transaction)
         {
             if (FALSE == g_cancellable_is_cancelled (viewer->priv->transaction->cancellable))
@@ -1735,6 +2627,7 @@ rstto_image_viewer_set_file (RsttoImageViewer *viewer, RsttoFile *file, gdouble
             }
             viewer->priv->transaction = NULL;
         }
+        rstto_image_viewer_cancel_refinement (viewer);
         if (viewer->priv->file)
         {
             g_signal_handlers_disconnect_by_func (
@@ -1758,46 +2651,219 @@ rstto_image_viewer_set_file (RsttoImageViewer *viewer, RsttoFile *file, gdouble
     }
 }
 
+/**
+ * rstto_image_viewer_get_decode_size:
+ * @viewer:
+ * @max_width: (out):
+ * @max_height: (out):
+ *
+ * Get the size images are limited to while decoding,
+ * 0 if the size is not limited.
+ */
 static void
-rstto_image_viewer_load_image (RsttoImageViewer *viewer, RsttoFile *file, gdouble scale)
+rstto_image_viewer_get_decode_size (
+        RsttoImageViewer *viewer,
+        gint *max_width,
+        gint *max_height)
 {
-    RsttoImageViewerTransaction *transaction = g_new0 (RsttoImageViewerTransaction, 1);
+    GdkWindow    *window = gtk_widget_get_window (GTK_WIDGET (viewer));
+    GdkDisplay   *display = gdk_screen_get_display (default_screen);
+    GdkMonitor   *monitor = NULL;
+    GdkRectangle  monitor_geometry;
 
-    /*
-     * This will first need to return to the 'main' loop before it cleans up after itself.
-     * We can forget about the transaction, once it's cancelled, it will clean-up itself. -- (it should)
-     */
-    if (viewer->priv->transaction)
+    *max_width = 0;
+    *max_height = 0;
+
+    if (TRUE == viewer->priv->limit_quality)
     {
-        g_cancellable_cancel (viewer->priv->transaction->cancellable);
-        viewer->priv->transaction = NULL;
-    }
+        /*
+         * Set the maximum size of the loaded image to the screen-size.
+         * TODO: Add some 'smart-stuff' here
+         */
+        if (NULL != window)
+        {
+            monitor = gdk_display_get_monitor_at_window (display, window);
+        }
+        else
+        {
+            monitor = gdk_display_get_primary_monitor (display);
+        }
 
-    transaction->loader = gdk_pixbuf_loader_new_with_mime_type (rstto_file_get_content_type (file), NULL);
+        if (NULL != monitor)
+        {
+            gdk_monitor_get_geometry (monitor, &monitor_geometry);
+            *max_width = monitor_geometry.width;
+            *max_height = monitor_geometry.height;
+        }
+    }
+}
 
-    /* HACK HACK HACK */
-    if (transaction->loader == NULL)
+/**
+ * rstto_image_viewer_get_preview_size:
+ * @viewer:
+ * @file:
+ * @max_width: Size the image is limited to, 0 for no limit
+ * @max_height:
+ * @width: (out): Size to first decode the image at
+ * @height: (out):
+ *
+ * Return value: TRUE if @file decodes faster at the size of the viewer,
+ *               and that size is smaller than @max_width and @max_height.
+ */
+static gboolean
+rstto_image_viewer_get_preview_size (
+        RsttoImageViewer *viewer,
+        RsttoFile *file,
+        gint max_width,
+        gint max_height,
+        gint *width,
+        gint *height)
+{
+    /* Sniffing the contents would block the main-loop */
+    const gchar   *content_type = rstto_file_get_known_content_type (file);
+    GtkAllocation  allocation;
+    gboolean       scaled_decode = FALSE;
+    gint           size;
+    gint           i;
+
+    if (NULL != content_type)
     {
-        transaction->loader = gdk_pixbuf_loader_new();
+        for (i = 0; NULL != rstto_image_viewer_scaled_decode[i]; ++i)
+        {
+            if (0 == g_strcmp0 (content_type, rstto_image_viewer_scaled_decode[i]))
+            {
+                scaled_decode = TRUE;
+                break;
+            }
+        }
     }
 
-    transaction->cancellable = g_cancellable_new();
-    transaction->buffer = g_new0 (guchar, RSTTO_IMAGE_VIEWER_BUFFER_SIZE);
-    transaction->file = file;
-    transaction->viewer = viewer;
-    transaction->scale = scale;
+    if (FALSE == scaled_decode)
+    {
+        return FALSE;
+    }
 
-    g_signal_connect(transaction->loader, "size-prepared", G_CALLBACK(cb_rstto_image_loader_size_prepared), transaction);
-    g_signal_connect(transaction->loader, "closed", G_CALLBACK(cb_rstto_image_loader_closed), transaction);
+    /* The image may be rotated, it has to fit either way */
+    gtk_widget_get_allocation (GTK_WIDGET (viewer), &allocation);
+    size = MAX (allocation.width, allocation.height) *
+           gtk_widget_get_scale_factor (GTK_WIDGET (viewer));
 
-    viewer->priv->transaction = transaction;
+    /* Not allocated yet */
+    if (size <= 1)
+    {
+        return FALSE;
+    }
 
-    g_file_read_async (rstto_file_get_file (transaction->file),
-                       0,
-                       transaction->cancellable,
-                       (GAsyncReadyCallback)cb_rstto_image_viewer_read_file_ready,
-                       transaction);
-}
+    if (max_width > 0 && max_height > 0 && size >= MIN (max_width, max_height))
+    {
+        return FALSE;
+    }
+
+    *width = size;
+    *height = size;
+
+    return TRUE;
+}
+
+static void
+rstto_image_viewer_load_image (RsttoImageViewer *viewer, RsttoFile *file, gdouble scale)
+{
+    RsttoImageViewerTransaction *transaction;
+    GdkPixbufAnimation          *animation;
+    RsttoImageOrientation        orientation = rstto_file_get_orientation (file);
+    RsttoImageOrientation        image_orientation;
+    gint                         max_width, max_height;
+    gint                         image_width, image_height;
+    gdouble                      image_scale;
+
+    /*
+     * This will first need to return to the 'main' loop before it cleans up after itself.
+     * We can forget about the transaction, once it's cancelled, it will clean-up itself. -- (it should)
+     */
+    if (viewer->priv->transaction)
+    {
+        g_cancellable_cancel (viewer->priv->transaction->cancellable);
+        viewer->priv->transaction = NULL;
+    }
+    rstto_image_viewer_cancel_refinement (viewer);
+
+    rstto_image_viewer_get_decode_size (viewer, &max_width, &max_height);
+
+    /*
+     * If the image was decoded before, or has been prefetched,
+     * there is no need to decode it again.
+     */
+    animation = rstto_image_cache_lookup (
+            viewer->priv->cache,
+            file,
+            max_width,
+            max_height,
+            orientation,
+            &image_width,
+            &image_height,
+            &image_scale,
+            &image_orientation);
+    if (NULL != animation)
+    {
+        gtk_widget_set_tooltip_text (GTK_WIDGET (viewer), NULL);
+        viewer->priv->image_scale = image_scale;
+        viewer->priv->image_width = image_width;
+        viewer->priv->image_height = image_height;
+        viewer->priv->orientation = image_orientation;
+        set_scale (viewer, scale);
+
+        rstto_image_viewer_set_animation (viewer, animation);
+        g_object_unref (animation);
+
+        gdk_window_invalidate_rect (gtk_widget_get_window (GTK_WIDGET (viewer)), NULL, FALSE);
+
+        g_signal_emit_by_name (viewer, "size-ready");
+        return;
+    }
+
+    transaction = g_new0 (RsttoImageViewerTransaction, 1);
+    transaction->max_width = max_width;
+    transaction->max_height = max_height;
+    transaction->full_width = max_width;
+    transaction->full_height = max_height;
+    transaction->cancellable = g_cancellable_new();
+    transaction->file = file;
+    transaction->viewer = viewer;
+    transaction->scale = scale;
+    transaction->orientation = orientation;
+
+    /*
+     * Show the image at the size of the viewer first, the time this takes
+     * does not depend on the size of the image. It is decoded at full size
+     * when that is needed.
+     */
+    rstto_image_viewer_get_preview_size (
+            viewer,
+            file,
+            max_width,
+            max_height,
+            &transaction->max_width,
+            &transaction->max_height);
+
+    viewer->priv->transaction = transaction;
+
+    rstto_image_viewer_show_placeholder (viewer, transaction);
+
+    /*
+     * The image is decoded in a worker-thread, the main-loop
+     * only sees the result.
+     */
+    rstto_image_decoder_decode_async (
+            viewer->priv->decoder,
+            file,
+            transaction->max_width,
+            transaction->max_height,
+            G_PRIORITY_DEFAULT,
+            transaction->cancellable,
+            cb_rstto_image_viewer_decode_progress,
+            cb_rstto_image_viewer_decode_ready,
+            transaction);
+}
 
 static void
 rstto_image_viewer_transaction_free (RsttoImageViewerTransaction *tr)
@@ -1810,16 +2876,195 @@ rstto_image_viewer_transaction_free (RsttoImageViewerTransaction *tr)
     {
         tr->viewer->priv->transaction = NULL;
     }
+    if (tr->viewer->priv->refinement == tr)
+    {
+        tr->viewer->priv->refinement = NULL;
+    }
     if (tr->error)
     {
         g_error_free (tr->error);
     }
     g_object_unref (tr->cancellable);
-    g_object_unref (tr->loader);
-    g_free (tr->buffer);
     g_free (tr);
 }
 
+/**
+ * rstto_image_viewer_show_placeholder:
+ * @viewer:
+ * @transaction:
+ *
+ * Until @transaction is done, show the best version of its file that
+ * is available without decoding it: the thumbnail from the thumbnail
+ * cache, or the thumbnail that is embedded in the EXIF data once
+ * the metadata-reader extracted it. It is scaled to the size of the image, so the decoded image replaces
+ * it in place.
+ */
+static void
+rstto_image_viewer_show_placeholder (
+        RsttoImageViewer *viewer,
+        RsttoImageViewerTransaction *transaction)
+{
+    const RsttoFileMetadata *metadata = rstto_file_get_metadata (transaction->file);
+    GdkPixbuf               *pixbuf = NULL;
+    const gchar             *width_option;
+    const gchar             *height_option;
+    gint                     image_width = 0;
+    gint                     image_height = 0;
+
+    /* Thumbnailers store the thumbnail upright, the EXIF
+     * thumbnail is stored the same way as the image.
+     */
+    if (RSTTO_IMAGE_ORIENT_NONE == transaction->orientation)
+    {
+        pixbuf = (GdkPixbuf *) rstto_file_get_thumbnail (
+                transaction->file,
+                THUMBNAIL_SIZE_LARGER);
+        if (NULL != pixbuf)
+        {
+            g_object_ref (pixbuf);
+        }
+    }
+
+    if (NULL == pixbuf)
+    {
+        pixbuf = rstto_file_get_exif_thumbnail (transaction->file);
+        if (NULL != pixbuf)
+        {
+            g_object_ref (pixbuf);
+        }
+    }
+
+    /* Extracting the EXIF thumbnail reads the file, that is left to
+     * the metadata-reader. The placeholder is shown once it is ready.
+     */
+    if (NULL == pixbuf &&
+        FALSE == rstto_file_has_exif_thumbnail (transaction->file))
+    {
+        rstto_metadata_reader_queue_file (
+                viewer->priv->metadata_reader,
+                transaction->file,
+                RSTTO_METADATA_EXIF_THUMBNAIL,
+                transaction->cancellable);
+        return;
+    }
+
+    if (NULL == pixbuf)
+    {
+        return;
+    }
+
+    transaction->placeholder = TRUE;
+
+    /* The size of the image, to scale the placeholder to */
+    if (NULL != metadata && metadata->width > 0 && metadata->height > 0)
+    {
+        image_width = metadata->width;
+        image_height = metadata->height;
+    }
+    else
+    {
+        width_option = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::Image::Width");
+        height_option = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::Image::Height");
+        if (NULL != width_option && NULL != height_option)
+        {
+            image_width = (gint) g_ascii_strtoll (width_option, NULL, 10);
+            image_height = (gint) g_ascii_strtoll (height_option, NULL, 10);
+        }
+    }
+
+    if (image_width <= 0 || image_height <= 0)
+    {
+        image_width = gdk_pixbuf_get_width (pixbuf);
+        image_height = gdk_pixbuf_get_height (pixbuf);
+    }
+
+    gtk_widget_set_tooltip_text (GTK_WIDGET (viewer), NULL);
+    viewer->priv->image_scale = (gdouble) gdk_pixbuf_get_width (pixbuf) / (gdouble) image_width;
+    viewer->priv->image_width = image_width;
+    viewer->priv->image_height = image_height;
+    viewer->priv->orientation = transaction->orientation;
+    set_scale (viewer, transaction->scale);
+
+    /* Without an animation, no mipmap is built from the placeholder */
+    rstto_image_viewer_set_animation (viewer, NULL);
+    rstto_image_viewer_set_pixbuf (viewer, pixbuf);
+    g_object_unref (pixbuf);
+
+    gdk_window_invalidate_rect (gtk_widget_get_window (GTK_WIDGET (viewer)), NULL, FALSE);
+}
+
+/**
+ * rstto_image_viewer_refine:
+ * @viewer:
+ *
+ * Decode the image that was first decoded at the size of the viewer
+ * at full size. The result replaces it without changing the zoom.
+ */
+static void
+rstto_image_viewer_refine (RsttoImageViewer *viewer)
+{
+    RsttoImageViewerTransaction *transaction;
+
+    if (NULL == viewer->priv->file || NULL != viewer->priv->refinement)
+    {
+        return;
+    }
+
+    transaction = g_new0 (RsttoImageViewerTransaction, 1);
+    rstto_image_viewer_get_decode_size (
+            viewer,
+            &transaction->max_width,
+            &transaction->max_height);
+    transaction->full_width = transaction->max_width;
+    transaction->full_height = transaction->max_height;
+    transaction->cancellable = g_cancellable_new();
+    transaction->file = viewer->priv->file;
+    transaction->viewer = viewer;
+    transaction->scale = viewer->priv->scale;
+    transaction->orientation = rstto_file_get_orientation (transaction->file);
+
+    viewer->priv->refinement = transaction;
+
+    /* Before prefetching, after anything that is waited for */
+    rstto_image_decoder_decode_async (
+            viewer->priv->decoder,
+            transaction->file,
+            transaction->max_width,
+            transaction->max_height,
+            G_PRIORITY_DEFAULT_IDLE,
+            transaction->cancellable,
+            NULL,
+            cb_rstto_image_viewer_decode_ready,
+            transaction);
+}
+
+static gboolean
+cb_rstto_image_viewer_refine_timeout (gpointer user_data)
+{
+    RsttoImageViewer *viewer = user_data;
+
+    viewer->priv->refine_timeout_id = 0;
+    rstto_image_viewer_refine (viewer);
+
+    return FALSE;
+}
+
+static void
+rstto_image_viewer_cancel_refinement (RsttoImageViewer *viewer)
+{
+    if (viewer->priv->refine_timeout_id)
+    {
+        REMOVE_SOURCE (viewer->priv->refine_timeout_id);
+    }
+
+    /* Like the transaction, it cleans up after itself */
+    if (viewer->priv->refinement)
+    {
+        g_cancellable_cancel (viewer->priv->refinement->cancellable);
+        viewer->priv->refinement = NULL;
+    }
+}
+
 void
 rstto_image_viewer_set_scale (RsttoImageViewer *viewer, gdouble scale)
 {
@@ -1905,6 +3150,10 @@ static void
 rstto_image_viewer_set_motion_state (RsttoImageViewer *viewer, RsttoImageViewerMotionState state)
 {
     viewer->priv->motion.state = state;
+
+    rstto_image_viewer_update_overlay (
+            viewer,
+            RSTTO_IMAGE_VIEWER_OVERLAY_SELECTION_BOX);
 }
 
 /*
@@ -1917,270 +3166,1412 @@ rstto_image_viewer_set_motion_state (RsttoImageViewer *viewer, RsttoImageViewerM
 void
 rstto_image_viewer_set_orientation (RsttoImageViewer *viewer, RsttoImageOrientation orientation)
 {
-    GtkWidget *widget = GTK_WIDGET (viewer); 
+    GtkWidget *widget = GTK_WIDGET (viewer); 
+
+    viewer->priv->orientation = orientation;
+
+    if (viewer->priv->auto_scale)
+    {
+        set_scale (viewer, 0.0);
+    }
+
+    rstto_file_set_orientation (viewer->priv->file, orientation);
+
+    gdk_window_invalidate_rect (
+            gtk_widget_get_window (widget),
+            NULL,
+            FALSE);
+
+}
+
+RsttoImageOrientation
+rstto_image_viewer_get_orientation (RsttoImageViewer *viewer)
+{
+    if (viewer)
+    {
+        return viewer->priv->orientation;
+    }
+    return RSTTO_IMAGE_ORIENT_NONE;
+}
+
+gint
+rstto_image_viewer_get_width (RsttoImageViewer *viewer)
+{
+    if (viewer)
+    {
+        return viewer->priv->image_width;
+    }
+    return 0;
+}
+gint
+rstto_image_viewer_get_height (RsttoImageViewer *viewer)
+{
+    if (viewer)
+    {
+        return viewer->priv->image_height;
+    }
+    return 0;
+}
+
+void
+rstto_image_viewer_set_menu (RsttoImageViewer *viewer, GtkMenu *menu)
+{
+    if (viewer->priv->menu)
+    {
+        gtk_menu_detach(viewer->priv->menu);
+        gtk_widget_destroy(GTK_WIDGET(viewer->priv->menu));
+    }
+
+    viewer->priv->menu = menu;
+
+    if (viewer->priv->menu)
+    {
+        gtk_menu_attach_to_widget(
+                viewer->priv->menu,
+                GTK_WIDGET(viewer),
+                NULL);
+    }
+
+}
+
+
+/************************/
+/** CALLBACK FUNCTIONS **/
+/************************/
+
+static void
+cb_rstto_image_viewer_value_changed (GtkAdjustment *adjustment, RsttoImageViewer *viewer)
+{
+    GtkWidget *widget = GTK_WIDGET (viewer);
+
+    /* The backing-surface is shifted when the window is painted,
+     * moving the scrollbars several times before that only
+     * shifts it once. Panning does not use the fast filter, the
+     * strips that scroll into view are only painted once.
+     */
+    viewer->priv->backing.keep = TRUE;
+    gdk_window_invalidate_rect (gtk_widget_get_window (widget), NULL, FALSE);
+    viewer->priv->backing.keep = FALSE;
+}
+
+/**
+ * cb_rstto_image_viewer_invalidate:
+ * @window:
+ * @region: The region that is invalidated
+ *
+ * Mark the part of the backing-surface that is invalidated as
+ * dirty, unless the invalidation does not concern it.
+ */
+static void
+cb_rstto_image_viewer_invalidate (GdkWindow *window, cairo_region_t *region)
+{
+    RsttoImageViewer *viewer = NULL;
+
+    gdk_window_get_user_data (window, (gpointer *) &viewer);
+
+    if (viewer && viewer->priv && FALSE == viewer->priv->backing.keep)
+    {
+        cairo_region_union (viewer->priv->backing.dirty, region);
+    }
+}
+
+/**
+ * rstto_image_viewer_set_pixbuf:
+ * @viewer:
+ * @pixbuf: The pixbuf to paint, or NULL
+ *
+ * Replace the pixbuf that is painted, and drop the
+ * tiles that were converted from the old one.
+ */
+static void
+rstto_image_viewer_set_pixbuf (RsttoImageViewer *viewer, GdkPixbuf *pixbuf)
+{
+    if (NULL != pixbuf)
+    {
+        g_object_ref (pixbuf);
+    }
+
+    if (viewer->priv->pixbuf)
+    {
+        g_object_unref (viewer->priv->pixbuf);
+    }
+    viewer->priv->pixbuf = pixbuf;
+
+    rstto_image_viewer_clear_tiles (viewer);
+    rstto_image_viewer_dirty_backing (viewer);
+    viewer->priv->rendering.painted = FALSE;
+
+    /* The mipmap belongs to the old pixbuf */
+    if (viewer->priv->mipmap.cancellable)
+    {
+        g_cancellable_cancel (viewer->priv->mipmap.cancellable);
+        g_object_unref (viewer->priv->mipmap.cancellable);
+        viewer->priv->mipmap.cancellable = NULL;
+    }
+    g_clear_pointer (&viewer->priv->mipmap.pixbufs, g_ptr_array_unref);
+
+    rstto_image_viewer_cancel_resample (viewer);
+    g_clear_object (&viewer->priv->resample.pixbuf);
+}
+
+/**
+ * rstto_image_viewer_create_surface:
+ * @viewer:
+ * @pixbuf:
+ *
+ * Return value: @pixbuf converted to a surface that is similar to the window.
+ */
+static cairo_surface_t *
+rstto_image_viewer_create_surface (RsttoImageViewer *viewer, GdkPixbuf *pixbuf)
+{
+    cairo_surface_t *surface;
+    cairo_t         *ctx;
+
+    surface = gdk_window_create_similar_image_surface (
+            gtk_widget_get_window (GTK_WIDGET (viewer)),
+            gdk_pixbuf_get_has_alpha (pixbuf) ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24,
+            gdk_pixbuf_get_width (pixbuf),
+            gdk_pixbuf_get_height (pixbuf),
+            1);
+
+    ctx = cairo_create (surface);
+    cairo_set_operator (ctx, CAIRO_OPERATOR_SOURCE);
+    gdk_cairo_set_source_pixbuf (ctx, pixbuf, 0.0, 0.0);
+    cairo_paint (ctx);
+    cairo_destroy (ctx);
+
+    return surface;
+}
+
+/**
+ * rstto_image_viewer_clear_tiles:
+ * @viewer:
+ *
+ * Drop all tiles, they are converted again from
+ * the pixbuf and its mipmap on the next paint.
+ */
+static void
+rstto_image_viewer_clear_tiles (RsttoImageViewer *viewer)
+{
+    g_queue_clear (viewer->priv->tiles.lru);
+    g_hash_table_remove_all (viewer->priv->tiles.table);
+    viewer->priv->tiles.size = 0;
+}
+
+static void
+rstto_image_viewer_tile_free (RsttoImageViewerTile *tile)
+{
+    cairo_surface_destroy (tile->surface);
+    g_free (tile);
+}
+
+/**
+ * rstto_image_viewer_drop_tiles:
+ * @viewer:
+ * @n: The mipmap-level, 0 for the pixbuf itself
+ * @area: Part of the level that changed
+ *
+ * Drop the tiles of level @n that intersect @area.
+ */
+static void
+rstto_image_viewer_drop_tiles (
+        RsttoImageViewer *viewer,
+        guint n,
+        const GdkRectangle *area)
+{
+    RsttoImageViewerTile *tile;
+    guint64               key;
+    gint                  col, row;
+
+    for (row = area->y / RSTTO_IMAGE_VIEWER_TILE_SIZE;
+         row <= (area->y + area->height - 1) / RSTTO_IMAGE_VIEWER_TILE_SIZE;
+         ++row)
+    {
+        for (col = area->x / RSTTO_IMAGE_VIEWER_TILE_SIZE;
+             col <= (area->x + area->width - 1) / RSTTO_IMAGE_VIEWER_TILE_SIZE;
+             ++col)
+        {
+            key = ((guint64) n << 56) | ((guint64) row << 28) | (guint64) col;
+
+            tile = g_hash_table_lookup (viewer->priv->tiles.table, &key);
+            if (NULL != tile)
+            {
+                g_queue_delete_link (viewer->priv->tiles.lru, tile->link);
+                viewer->priv->tiles.size -= cairo_image_surface_get_stride (tile->surface) *
+                                            cairo_image_surface_get_height (tile->surface);
+                g_hash_table_remove (viewer->priv->tiles.table, &key);
+            }
+        }
+    }
+}
+
+/**
+ * rstto_image_viewer_get_tile:
+ * @viewer:
+ * @level: The pixbuf or one of its mipmap-levels
+ * @n: The mipmap-level of @level, 0 for the pixbuf itself
+ * @col:
+ * @row:
+ *
+ * Return value: The tile at @col, @row of @level, converted to a
+ *               surface when it is not in the tile-cache yet.
+ */
+static cairo_surface_t *
+rstto_image_viewer_get_tile (
+        RsttoImageViewer *viewer,
+        GdkPixbuf *level,
+        guint n,
+        gint col,
+        gint row)
+{
+    RsttoImageViewerTile *tile;
+    GdkPixbuf            *pixbuf;
+    GQueue               *lru = viewer->priv->tiles.lru;
+    guint64               key;
+    gint                  x = col * RSTTO_IMAGE_VIEWER_TILE_SIZE;
+    gint                  y = row * RSTTO_IMAGE_VIEWER_TILE_SIZE;
+
+    key = ((guint64) n << 56) | ((guint64) row << 28) | (guint64) col;
+
+    tile = g_hash_table_lookup (viewer->priv->tiles.table, &key);
+    if (NULL != tile)
+    {
+        /* Move it to the front of the lru-queue */
+        g_queue_unlink (lru, tile->link);
+        g_queue_push_head_link (lru, tile->link);
+        return tile->surface;
+    }
+
+    /* The sub-pixbuf shares the pixels of the level */
+    pixbuf = gdk_pixbuf_new_subpixbuf (
+            level,
+            x,
+            y,
+            MIN (RSTTO_IMAGE_VIEWER_TILE_SIZE, gdk_pixbuf_get_width (level) - x),
+            MIN (RSTTO_IMAGE_VIEWER_TILE_SIZE, gdk_pixbuf_get_height (level) - y));
+
+    tile = g_new0 (RsttoImageViewerTile, 1);
+    tile->key = key;
+    tile->surface = rstto_image_viewer_create_surface (viewer, pixbuf);
+    g_object_unref (pixbuf);
+
+    g_hash_table_insert (viewer->priv->tiles.table, &tile->key, tile);
+    g_queue_push_head (lru, tile);
+    tile->link = lru->head;
+    viewer->priv->tiles.size += cairo_image_surface_get_stride (tile->surface) *
+                                cairo_image_surface_get_height (tile->surface);
+
+    /* Drop the tiles that have not been painted for the longest time,
+     * the tile that was just converted is always kept.
+     */
+    while (viewer->priv->tiles.size > RSTTO_IMAGE_VIEWER_TILE_CACHE_SIZE &&
+           g_queue_get_length (lru) > 1)
+    {
+        RsttoImageViewerTile *last = g_queue_pop_tail (lru);
+
+        viewer->priv->tiles.size -= cairo_image_surface_get_stride (last->surface) *
+                                    cairo_image_surface_get_height (last->surface);
+        g_hash_table_remove (viewer->priv->tiles.table, &last->key);
+    }
+
+    return tile->surface;
+}
+
+/**
+ * rstto_image_viewer_paint_tiles:
+ * @viewer:
+ * @ctx: Context that is transformed to the pixels of @level
+ * @level: The pixbuf or one of its mipmap-levels
+ * @n: The mipmap-level of @level, 0 for the pixbuf itself
+ * @filter: Filter the tiles are scaled with
+ *
+ * Paint the tiles of @level that intersect the clip of @ctx.
+ * The transformation of @ctx is derived from the hadjustment and
+ * vadjustment, so the clip is the visible part of the image, and
+ * tiles outside of it are never converted.
+ */
+static void
+rstto_image_viewer_paint_tiles (
+        RsttoImageViewer *viewer,
+        cairo_t *ctx,
+        GdkPixbuf *level,
+        guint n,
+        cairo_filter_t filter)
+{
+    gint    width = gdk_pixbuf_get_width (level);
+    gint    height = gdk_pixbuf_get_height (level);
+    gint    first_col, last_col, first_row, last_row;
+    gint    col, row;
+    gdouble x1, y1, x2, y2;
+
+    cairo_clip_extents (ctx, &x1, &y1, &x2, &y2);
+    if (x2 <= 0.0 || y2 <= 0.0 || x1 >= width || y1 >= height)
+    {
+        return;
+    }
+
+    first_col = MAX (0, (gint) floor (x1 / RSTTO_IMAGE_VIEWER_TILE_SIZE));
+    first_row = MAX (0, (gint) floor (y1 / RSTTO_IMAGE_VIEWER_TILE_SIZE));
+    last_col = MIN ((width - 1) / RSTTO_IMAGE_VIEWER_TILE_SIZE,
+                    (gint) ceil (x2 / RSTTO_IMAGE_VIEWER_TILE_SIZE) - 1);
+    last_row = MIN ((height - 1) / RSTTO_IMAGE_VIEWER_TILE_SIZE,
+                    (gint) ceil (y2 / RSTTO_IMAGE_VIEWER_TILE_SIZE) - 1);
+
+    cairo_save (ctx);
+
+    /* Adjacent tiles would both blend into the pixels along
+     * their shared edge, leaving a visible seam.
+     */
+    cairo_set_antialias (ctx, CAIRO_ANTIALIAS_NONE);
+
+    for (row = first_row; row <= last_row; ++row)
+    {
+        for (col = first_col; col <= last_col; ++col)
+        {
+            gint x = col * RSTTO_IMAGE_VIEWER_TILE_SIZE;
+            gint y = row * RSTTO_IMAGE_VIEWER_TILE_SIZE;
+
+            cairo_set_source_surface (
+                    ctx,
+                    rstto_image_viewer_get_tile (viewer, level, n, col, row),
+                    x,
+                    y);
+
+            /* Filter against the edge of the tile, not against transparency */
+            cairo_pattern_set_extend (cairo_get_source (ctx), CAIRO_EXTEND_PAD);
+            cairo_pattern_set_filter (cairo_get_source (ctx), filter);
+
+            cairo_rectangle (
+                    ctx,
+                    x,
+                    y,
+                    MIN (RSTTO_IMAGE_VIEWER_TILE_SIZE, width - x),
+                    MIN (RSTTO_IMAGE_VIEWER_TILE_SIZE, height - y));
+            cairo_fill (ctx);
+        }
+    }
+
+    cairo_restore (ctx);
+}
+
+/**
+ * rstto_image_viewer_mipmap_thread:
+ *
+ * Build the mipmap-levels of the pixbuf in the task-data,
+ * every level is scaled down from the one before it.
+ */
+static void
+rstto_image_viewer_mipmap_thread (
+        GTask *task,
+        gpointer source_object,
+        gpointer task_data,
+        GCancellable *cancellable)
+{
+    GdkPixbuf *level = task_data;
+    GPtrArray *pixbufs = g_ptr_array_new_with_free_func (g_object_unref);
+    gint       width = gdk_pixbuf_get_width (level);
+    gint       height = gdk_pixbuf_get_height (level);
+
+    while (width / 2 >= RSTTO_IMAGE_VIEWER_MIPMAP_MIN_SIZE &&
+           height / 2 >= RSTTO_IMAGE_VIEWER_MIPMAP_MIN_SIZE)
+    {
+        if (g_task_return_error_if_cancelled (task))
+        {
+            g_ptr_array_unref (pixbufs);
+            return;
+        }
+
+        width /= 2;
+        height /= 2;
+
+        /* At 2:1 the bilinear filter averages every 2x2 block */
+        level = gdk_pixbuf_scale_simple (level, width, height, GDK_INTERP_BILINEAR);
+        if (NULL == level)
+        {
+            break;
+        }
+        g_ptr_array_add (pixbufs, level);
+    }
+
+    g_task_return_pointer (task, pixbufs, (GDestroyNotify) g_ptr_array_unref);
+}
+
+static void
+cb_rstto_image_viewer_mipmap_ready (
+        GObject *source_object,
+        GAsyncResult *result,
+        gpointer user_data)
+{
+    RsttoImageViewer *viewer = RSTTO_IMAGE_VIEWER (source_object);
+    GPtrArray        *pixbufs;
+
+    pixbufs = g_task_propagate_pointer (G_TASK (result), NULL);
+    if (NULL == pixbufs)
+    {
+        return;
+    }
+
+    /* The pixbuf changed while the levels were built */
+    if (NULL == viewer->priv ||
+        g_task_get_task_data (G_TASK (result)) != viewer->priv->pixbuf)
+    {
+        g_ptr_array_unref (pixbufs);
+        return;
+    }
+
+    viewer->priv->mipmap.pixbufs = pixbufs;
+
+    gdk_window_invalidate_rect (
+            gtk_widget_get_window (GTK_WIDGET (viewer)),
+            NULL,
+            FALSE);
+}
+
+/**
+ * rstto_image_viewer_get_mipmap:
+ * @viewer:
+ * @scale: The scale at which the pixbuf is painted
+ * @n: (out): The mipmap-level that is returned
+ * @x_scale: (out): Horizontal size of the pixbuf relative to the returned level
+ * @y_scale: (out): Vertical size of the pixbuf relative to the returned level
+ *
+ * Return value: The smallest mipmap-level that is still at least as large as
+ *               the painted image. Until the levels are built, this is the
+ *               pixbuf itself.
+ */
+static GdkPixbuf *
+rstto_image_viewer_get_mipmap (
+        RsttoImageViewer *viewer,
+        gdouble scale,
+        guint *n,
+        gdouble *x_scale,
+        gdouble *y_scale)
+{
+    GdkPixbuf *level;
+    GTask     *task;
+
+    *n = 0;
+    *x_scale = 1.0;
+    *y_scale = 1.0;
+
+    /* Animations are painted from their composited frames */
+    if (scale <= 0.5 && NULL != viewer->priv->pixbuf &&
+        NULL != viewer->priv->animation &&
+        gdk_pixbuf_animation_is_static_image (viewer->priv->animation))
+    {
+        if (NULL != viewer->priv->mipmap.pixbufs)
+        {
+            while (*n < viewer->priv->mipmap.pixbufs->len && scale * (gdouble) (2 << *n) <= 1.0)
+            {
+                ++(*n);
+            }
+        }
+        else if (NULL == viewer->priv->mipmap.cancellable)
+        {
+            viewer->priv->mipmap.cancellable = g_cancellable_new ();
+
+            task = g_task_new (
+                    viewer,
+                    viewer->priv->mipmap.cancellable,
+                    cb_rstto_image_viewer_mipmap_ready,
+                    NULL);
+            g_task_set_task_data (task, g_object_ref (viewer->priv->pixbuf), g_object_unref);
+            g_task_run_in_thread (task, rstto_image_viewer_mipmap_thread);
+            g_object_unref (task);
+        }
+    }
+
+    if (0 == *n)
+    {
+        return viewer->priv->pixbuf;
+    }
+
+    level = g_ptr_array_index (viewer->priv->mipmap.pixbufs, *n - 1);
+
+    *x_scale = (gdouble) gdk_pixbuf_get_width (viewer->priv->pixbuf) /
+               (gdouble) gdk_pixbuf_get_width (level);
+    *y_scale = (gdouble) gdk_pixbuf_get_height (viewer->priv->pixbuf) /
+               (gdouble) gdk_pixbuf_get_height (level);
+
+    return level;
+}
+
+static void
+rstto_image_viewer_resample_free (RsttoImageViewerResample *resample)
+{
+    g_object_unref (resample->level);
+    g_free (resample);
+}
+
+/**
+ * rstto_image_viewer_resample_thread:
+ *
+ * Scale the mipmap-level in the task-data down to
+ * the size the pixbuf is painted at.
+ */
+static void
+rstto_image_viewer_resample_thread (
+        GTask *task,
+        gpointer source_object,
+        gpointer task_data,
+        GCancellable *cancellable)
+{
+    RsttoImageViewerResample *resample = task_data;
+
+    if (g_task_return_error_if_cancelled (task))
+    {
+        return;
+    }
+
+    /* When scaling down, the bilinear filter of gdk-pixbuf
+     * averages the area every destination-pixel covers.
+     */
+    g_task_return_pointer (
+            task,
+            gdk_pixbuf_scale_simple (
+                    resample->level,
+                    resample->width,
+                    resample->height,
+                    GDK_INTERP_BILINEAR),
+            g_object_unref);
+}
+
+static void
+cb_rstto_image_viewer_resample_ready (
+        GObject *source_object,
+        GAsyncResult *result,
+        gpointer user_data)
+{
+    RsttoImageViewer         *viewer = RSTTO_IMAGE_VIEWER (source_object);
+    RsttoImageViewerResample *resample = g_task_get_task_data (G_TASK (result));
+    GdkPixbuf                *pixbuf;
+
+    pixbuf = g_task_propagate_pointer (G_TASK (result), NULL);
+    if (NULL == pixbuf)
+    {
+        return;
+    }
+
+    /* The pixbuf or the scale changed while it was resampled */
+    if (NULL == viewer->priv ||
+        g_task_get_cancellable (G_TASK (result)) != viewer->priv->resample.cancellable)
+    {
+        g_object_unref (pixbuf);
+        return;
+    }
+
+    g_clear_object (&viewer->priv->resample.cancellable);
+    if (viewer->priv->resample.pixbuf)
+    {
+        g_object_unref (viewer->priv->resample.pixbuf);
+    }
+    viewer->priv->resample.pixbuf = pixbuf;
+    viewer->priv->resample.scale = resample->scale;
+
+    /* The tiles of the pixbuf that was resampled before */
+    rstto_image_viewer_clear_tiles (viewer);
+
+    gdk_window_invalidate_rect (
+            gtk_widget_get_window (GTK_WIDGET (viewer)),
+            NULL,
+            FALSE);
+}
+
+/**
+ * rstto_image_viewer_get_resampled:
+ * @viewer:
+ *
+ * Return value: The pixbuf resampled to the scale it is painted at, or
+ *               NULL if there is none. When the image is scaled down
+ *               and not interacted with, it is resampled in a
+ *               worker-thread.
+ */
+static GdkPixbuf *
+rstto_image_viewer_get_resampled (RsttoImageViewer *viewer)
+{
+    RsttoImageViewerResample *resample;
+    GdkPixbuf *level;
+    GTask     *task;
+    gdouble    scale = viewer->priv->scale / viewer->priv->image_scale;
+    gdouble    x_scale, y_scale;
+    guint      n;
+    gint       width, height;
+
+    if (NULL != viewer->priv->resample.pixbuf &&
+        viewer->priv->resample.scale == viewer->priv->scale)
+    {
+        return viewer->priv->resample.pixbuf;
+    }
+
+    /* Animations are painted from their composited frames */
+    if (viewer->priv->resample.interacting || scale >= 1.0 ||
+        NULL == viewer->priv->pixbuf ||
+        NULL == viewer->priv->animation ||
+        FALSE == gdk_pixbuf_animation_is_static_image (viewer->priv->animation))
+    {
+        return NULL;
+    }
+
+    width = (gint) round (gdk_pixbuf_get_width (viewer->priv->pixbuf) * scale);
+    height = (gint) round (gdk_pixbuf_get_height (viewer->priv->pixbuf) * scale);
+    if (width < 1 || height < 1 ||
+        (gint64) width * height > RSTTO_IMAGE_VIEWER_RESAMPLE_MAX_PIXELS)
+    {
+        return NULL;
+    }
+
+    /* Already resampling for this scale */
+    if (NULL != viewer->priv->resample.cancellable &&
+        viewer->priv->resample.pending_scale == viewer->priv->scale)
+    {
+        return NULL;
+    }
+
+    rstto_image_viewer_cancel_resample (viewer);
+
+    level = rstto_image_viewer_get_mipmap (viewer, scale, &n, &x_scale, &y_scale);
+
+    resample = g_new0 (RsttoImageViewerResample, 1);
+    resample->level = g_object_ref (level);
+    resample->width = width;
+    resample->height = height;
+    resample->scale = viewer->priv->scale;
+
+    viewer->priv->resample.cancellable = g_cancellable_new ();
+    viewer->priv->resample.pending_scale = viewer->priv->scale;
+
+    task = g_task_new (
+            viewer,
+            viewer->priv->resample.cancellable,
+            cb_rstto_image_viewer_resample_ready,
+            NULL);
+    g_task_set_task_data (task, resample, (GDestroyNotify) rstto_image_viewer_resample_free);
+    g_task_run_in_thread (task, rstto_image_viewer_resample_thread);
+    g_object_unref (task);
+
+    return NULL;
+}
+
+/**
+ * rstto_image_viewer_cancel_resample:
+ * @viewer:
+ *
+ * Stop resampling the pixbuf, if it is.
+ */
+static void
+rstto_image_viewer_cancel_resample (RsttoImageViewer *viewer)
+{
+    if (viewer->priv->resample.cancellable)
+    {
+        g_cancellable_cancel (viewer->priv->resample.cancellable);
+        g_object_unref (viewer->priv->resample.cancellable);
+        viewer->priv->resample.cancellable = NULL;
+    }
+}
+
+static gboolean
+cb_rstto_image_viewer_settle_timeout (gpointer user_data)
+{
+    RsttoImageViewer *viewer = user_data;
+
+    viewer->priv->resample.timeout_id = 0;
+    viewer->priv->resample.interacting = FALSE;
+
+    /* Paint what was painted with the fast filter again */
+    if (viewer->priv->resample.fast)
+    {
+        viewer->priv->resample.fast = FALSE;
+        gdk_window_invalidate_rect (
+                gtk_widget_get_window (GTK_WIDGET (viewer)),
+                NULL,
+                FALSE);
+    }
+
+    return FALSE;
+}
+
+/**
+ * rstto_image_viewer_interact:
+ * @viewer:
+ *
+ * Paint the image with a fast filter until it has not been
+ * zoomed or resized for RSTTO_IMAGE_VIEWER_SETTLE_DELAY.
+ */
+static void
+rstto_image_viewer_interact (RsttoImageViewer *viewer)
+{
+    viewer->priv->resample.interacting = TRUE;
+
+    if (viewer->priv->resample.timeout_id)
+    {
+        REMOVE_SOURCE (viewer->priv->resample.timeout_id);
+    }
+    viewer->priv->resample.timeout_id = g_timeout_add (
+            RSTTO_IMAGE_VIEWER_SETTLE_DELAY,
+            cb_rstto_image_viewer_settle_timeout,
+            viewer);
+}
+
+static void
+rstto_image_viewer_frame_free (RsttoImageViewerFrame *frame)
+{
+    cairo_surface_destroy (frame->surface);
+    g_free (frame);
+}
+
+/**
+ * rstto_image_viewer_get_frame_damage:
+ * @previous: (nullable): The frame before @surface
+ * @surface:
+ * @damage: (out): The part of @surface that differs from @previous
+ */
+static void
+rstto_image_viewer_get_frame_damage (
+        cairo_surface_t *previous,
+        cairo_surface_t *surface,
+        cairo_rectangle_int_t *damage)
+{
+    gint           width = cairo_image_surface_get_width (surface);
+    gint           height = cairo_image_surface_get_height (surface);
+    gint           stride = cairo_image_surface_get_stride (surface);
+    const guchar  *a, *b;
+    const guint32 *row_a, *row_b;
+    gint           top, bottom, left, right, x, y;
+
+    damage->x = 0;
+    damage->y = 0;
+    damage->width = width;
+    damage->height = height;
+
+    if (NULL == previous ||
+        width != cairo_image_surface_get_width (previous) ||
+        height != cairo_image_surface_get_height (previous) ||
+        stride != cairo_image_surface_get_stride (previous))
+    {
+        return;
+    }
+
+    cairo_surface_flush (previous);
+    cairo_surface_flush (surface);
+    a = cairo_image_surface_get_data (previous);
+    b = cairo_image_surface_get_data (surface);
+
+    /* Both formats use 32 bits per pixel */
+    for (top = 0; top < height; ++top)
+    {
+        if (0 != memcmp (a + top * stride, b + top * stride, width * 4))
+        {
+            break;
+        }
+    }
+
+    if (top == height)
+    {
+        damage->width = 0;
+        damage->height = 0;
+        return;
+    }
+
+    for (bottom = height - 1; bottom > top; --bottom)
+    {
+        if (0 != memcmp (a + bottom * stride, b + bottom * stride, width * 4))
+        {
+            break;
+        }
+    }
+
+    left = width;
+    right = -1;
+    for (y = top; y <= bottom; ++y)
+    {
+        row_a = (const guint32 *) (a + y * stride);
+        row_b = (const guint32 *) (b + y * stride);
+
+        for (x = 0; x < left && row_a[x] == row_b[x]; ++x);
+        left = x;
+
+        for (x = width - 1; x > right && row_a[x] == row_b[x]; --x);
+        right = x;
+    }
+
+    damage->x = left;
+    damage->y = top;
+    damage->width = MAX (0, right - left + 1);
+    damage->height = bottom - top + 1;
+}
+
+static void
+rstto_image_viewer_composite_free (RsttoImageViewerComposite *composite)
+{
+    g_object_unref (composite->iter);
+    if (NULL != composite->last)
+    {
+        cairo_surface_destroy (composite->last);
+    }
+    g_free (composite);
+}
+
+/**
+ * rstto_image_viewer_composite_thread:
+ *
+ * Composite the frame the iter in the task-data points at into
+ * a surface, and advance the iter to the frame after it.
+ */
+static void
+rstto_image_viewer_composite_thread (
+        GTask *task,
+        gpointer source_object,
+        gpointer task_data,
+        GCancellable *cancellable)
+{
+    RsttoImageViewerComposite *composite = task_data;
+    RsttoImageViewerFrame     *frame;
+    GdkPixbuf                 *pixbuf;
+    cairo_t                   *ctx;
+
+    if (g_task_return_error_if_cancelled (task))
+    {
+        return;
+    }
+
+    pixbuf = gdk_pixbuf_animation_iter_get_pixbuf (composite->iter);
+
+    frame = g_new0 (RsttoImageViewerFrame, 1);
+    frame->surface = cairo_image_surface_create (
+            gdk_pixbuf_get_has_alpha (pixbuf) ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24,
+            gdk_pixbuf_get_width (pixbuf),
+            gdk_pixbuf_get_height (pixbuf));
+    ctx = cairo_create (frame->surface);
+    cairo_set_operator (ctx, CAIRO_OPERATOR_SOURCE);
+    gdk_cairo_set_source_pixbuf (ctx, pixbuf, 0.0, 0.0);
+    cairo_paint (ctx);
+    cairo_destroy (ctx);
+
+    frame->delay = gdk_pixbuf_animation_iter_get_delay_time (composite->iter);
+    if (frame->delay >= 0)
+    {
+        frame->delay = MAX (frame->delay, RSTTO_IMAGE_VIEWER_MIN_FRAME_DELAY);
+    }
+
+    rstto_image_viewer_get_frame_damage (
+            composite->last,
+            frame->surface,
+            &frame->damage);
+
+    if (frame->delay >= 0)
+    {
+        /* The iter follows the animation-time, not the clock */
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        g_time_val_add (&composite->time, frame->delay * 1000);
+        gdk_pixbuf_animation_iter_advance (composite->iter, &composite->time);
+G_GNUC_END_IGNORE_DEPRECATIONS
+    }
+
+    g_task_return_pointer (
+            task,
+            frame,
+            (GDestroyNotify) rstto_image_viewer_frame_free);
+}
+
+static void
+cb_rstto_image_viewer_composite_ready (
+        GObject *source_object,
+        GAsyncResult *result,
+        gpointer user_data)
+{
+    RsttoImageViewer          *viewer = RSTTO_IMAGE_VIEWER (source_object);
+    RsttoImageViewerComposite *composite = g_task_get_task_data (G_TASK (result));
+    RsttoImageViewerFrame     *frame;
+
+    frame = g_task_propagate_pointer (G_TASK (result), NULL);
+    if (NULL == frame)
+    {
+        return;
+    }
+
+    /* The animation was stopped while the frame was composited */
+    if (NULL == viewer->priv ||
+        g_task_get_cancellable (G_TASK (result)) != viewer->priv->frames.cancellable)
+    {
+        rstto_image_viewer_frame_free (frame);
+        return;
+    }
+
+    g_clear_object (&viewer->priv->frames.cancellable);
+    viewer->priv->frames.time = composite->time;
+    if (NULL != viewer->priv->frames.last)
+    {
+        cairo_surface_destroy (viewer->priv->frames.last);
+    }
+    viewer->priv->frames.last = cairo_surface_reference (frame->surface);
+
+    g_queue_push_tail (viewer->priv->frames.ring, frame);
+
+    if (frame->delay < 0)
+    {
+        viewer->priv->frames.done = TRUE;
+    }
+
+    rstto_image_viewer_composite_next (viewer);
+}
+
+/**
+ * rstto_image_viewer_composite_next:
+ * @viewer:
+ *
+ * Composite the next frame of the animation in a worker-thread, until
+ * the ring of frames that are ready to be displayed is full.
+ */
+static void
+rstto_image_viewer_composite_next (RsttoImageViewer *viewer)
+{
+    RsttoImageViewerComposite *composite;
+    GTask                     *task;
+    guint                      length = g_queue_get_length (viewer->priv->frames.ring);
+    gsize                      frame_size = 0;
+
+    if (NULL != viewer->priv->frames.last)
+    {
+        frame_size = cairo_image_surface_get_stride (viewer->priv->frames.last) *
+                     cairo_image_surface_get_height (viewer->priv->frames.last);
+    }
+
+    /* There is only one frame composited at a time, they
+     * all advance the same iter.
+     */
+    if (NULL != viewer->priv->frames.cancellable ||
+        viewer->priv->frames.done ||
+        length >= RSTTO_IMAGE_VIEWER_FRAME_RING_SIZE ||
+        (length >= 2 && (length + 1) * frame_size > RSTTO_IMAGE_VIEWER_FRAME_RING_BUDGET))
+    {
+        return;
+    }
+
+    composite = g_new0 (RsttoImageViewerComposite, 1);
+    composite->iter = g_object_ref (viewer->priv->frames.iter);
+    composite->time = viewer->priv->frames.time;
+    if (NULL != viewer->priv->frames.last)
+    {
+        composite->last = cairo_surface_reference (viewer->priv->frames.last);
+    }
+
+    viewer->priv->frames.cancellable = g_cancellable_new ();
+
+    task = g_task_new (
+            viewer,
+            viewer->priv->frames.cancellable,
+            cb_rstto_image_viewer_composite_ready,
+            NULL);
+    g_task_set_task_data (
+            task,
+            composite,
+            (GDestroyNotify) rstto_image_viewer_composite_free);
+    g_task_run_in_thread (task, rstto_image_viewer_composite_thread);
+    g_object_unref (task);
+}
+
+/**
+ * rstto_image_viewer_invalidate_area:
+ * @viewer:
+ * @matrix: Maps the pixels of the image to the window
+ * @area: Part of the image that changed
+ *
+ * Invalidate the part of the window that @area is painted in.
+ */
+static void
+rstto_image_viewer_invalidate_area (
+        RsttoImageViewer *viewer,
+        const cairo_matrix_t *matrix,
+        const GdkRectangle *area)
+{
+    GdkWindow    *window = gtk_widget_get_window (GTK_WIDGET (viewer));
+    GdkRectangle  rect;
+    gdouble       x[4], y[4];
+    gdouble       x1, y1, x2, y2;
+    gint          i;
+
+    x[0] = x[3] = area->x;
+    x[1] = x[2] = area->x + area->width;
+    y[0] = y[1] = area->y;
+    y[2] = y[3] = area->y + area->height;
+
+    /* The image may be rotated or flipped */
+    x1 = y1 = G_MAXDOUBLE;
+    x2 = y2 = -G_MAXDOUBLE;
+    for (i = 0; i < 4; ++i)
+    {
+        cairo_matrix_transform_point (matrix, &x[i], &y[i]);
+        x1 = MIN (x1, x[i]);
+        y1 = MIN (y1, y[i]);
+        x2 = MAX (x2, x[i]);
+        y2 = MAX (y2, y[i]);
+    }
+
+    /* The filter blends in the pixels around the area */
+    rect.x = (gint) floor (x1) - 1;
+    rect.y = (gint) floor (y1) - 1;
+    rect.width = (gint) ceil (x2) + 1 - rect.x;
+    rect.height = (gint) ceil (y2) + 1 - rect.y;
+
+    gdk_window_invalidate_rect (window, &rect, FALSE);
+}
+
+/**
+ * rstto_image_viewer_invalidate_frame:
+ * @viewer:
+ * @frame: The frame that replaces the displayed one
+ *
+ * Invalidate the part of the window that @frame changes.
+ */
+static void
+rstto_image_viewer_invalidate_frame (
+        RsttoImageViewer *viewer,
+        RsttoImageViewerFrame *frame)
+{
+    if (NULL == viewer->priv->frames.current || FALSE == viewer->priv->frames.painted)
+    {
+        gdk_window_invalidate_rect (gtk_widget_get_window (GTK_WIDGET (viewer)), NULL, FALSE);
+        return;
+    }
+
+    if (0 == frame->damage.width || 0 == frame->damage.height)
+    {
+        return;
+    }
+
+    rstto_image_viewer_invalidate_area (viewer, &viewer->priv->frames.matrix, &frame->damage);
+}
+
+static gboolean
+cb_rstto_image_viewer_animation_tick (
+        GtkWidget *widget,
+        GdkFrameClock *frame_clock,
+        gpointer user_data)
+{
+    RsttoImageViewer      *viewer = RSTTO_IMAGE_VIEWER (widget);
+    RsttoImageViewerFrame *frame;
+    gint64                 now = gdk_frame_clock_get_frame_time (frame_clock);
 
-    viewer->priv->orientation = orientation;
+    /* Keep the ring filled */
+    rstto_image_viewer_composite_next (viewer);
 
-    if (viewer->priv->auto_scale)
+    if (NULL != viewer->priv->frames.current && now < viewer->priv->frames.due)
     {
-        set_scale (viewer, 0.0);
+        return G_SOURCE_CONTINUE;
     }
 
-    rstto_file_set_orientation (viewer->priv->file, orientation);
-
-    gdk_window_invalidate_rect (
-            gtk_widget_get_window (widget),
-            NULL,
-            FALSE);
+    /* Show the next frame as soon as it is composited */
+    frame = g_queue_pop_head (viewer->priv->frames.ring);
+    if (NULL == frame)
+    {
+        return G_SOURCE_CONTINUE;
+    }
 
-}
+    rstto_image_viewer_invalidate_frame (viewer, frame);
 
-RsttoImageOrientation
-rstto_image_viewer_get_orientation (RsttoImageViewer *viewer)
-{
-    if (viewer)
+    if (NULL != viewer->priv->frames.current)
     {
-        return viewer->priv->orientation;
+        rstto_image_viewer_frame_free (viewer->priv->frames.current);
     }
-    return RSTTO_IMAGE_ORIENT_NONE;
-}
+    viewer->priv->frames.current = frame;
 
-gint
-rstto_image_viewer_get_width (RsttoImageViewer *viewer)
-{
-    if (viewer)
+    if (frame->delay < 0)
     {
-        return viewer->priv->image_width;
+        viewer->priv->frames.tick_id = 0;
+        return G_SOURCE_REMOVE;
     }
-    return 0;
-}
-gint
-rstto_image_viewer_get_height (RsttoImageViewer *viewer)
-{
-    if (viewer)
+
+    /* Frames that are shown late do not delay the ones after them,
+     * unless the animation fell behind by more than a frame.
+     */
+    viewer->priv->frames.due += frame->delay * 1000;
+    if (viewer->priv->frames.due <= now)
     {
-        return viewer->priv->image_height;
+        viewer->priv->frames.due = now + frame->delay * 1000;
     }
-    return 0;
+
+    return G_SOURCE_CONTINUE;
 }
 
-void
-rstto_image_viewer_set_menu (RsttoImageViewer *viewer, GtkMenu *menu)
+static void
+rstto_image_viewer_stop_animation (RsttoImageViewer *viewer)
 {
-    if (viewer->priv->menu)
+    RsttoImageViewerFrame *frame;
+
+    if (viewer->priv->frames.tick_id)
     {
-        gtk_menu_detach(viewer->priv->menu);
-        gtk_widget_destroy(GTK_WIDGET(viewer->priv->menu));
+        gtk_widget_remove_tick_callback (GTK_WIDGET (viewer), viewer->priv->frames.tick_id);
+        viewer->priv->frames.tick_id = 0;
     }
 
-    viewer->priv->menu = menu;
+    if (viewer->priv->frames.cancellable)
+    {
+        g_cancellable_cancel (viewer->priv->frames.cancellable);
+        g_object_unref (viewer->priv->frames.cancellable);
+        viewer->priv->frames.cancellable = NULL;
+    }
 
-    if (viewer->priv->menu)
+    while (NULL != (frame = g_queue_pop_head (viewer->priv->frames.ring)))
     {
-        gtk_menu_attach_to_widget(
-                viewer->priv->menu,
-                GTK_WIDGET(viewer),
-                NULL);
+        rstto_image_viewer_frame_free (frame);
     }
 
-}
+    if (NULL != viewer->priv->frames.current)
+    {
+        rstto_image_viewer_frame_free (viewer->priv->frames.current);
+        viewer->priv->frames.current = NULL;
+    }
 
+    if (NULL != viewer->priv->frames.last)
+    {
+        cairo_surface_destroy (viewer->priv->frames.last);
+        viewer->priv->frames.last = NULL;
+    }
 
-/************************/
-/** CALLBACK FUNCTIONS **/
-/************************/
+    if (NULL != viewer->priv->frames.iter)
+    {
+        g_object_unref (viewer->priv->frames.iter);
+        viewer->priv->frames.iter = NULL;
+    }
 
-static void
-cb_rstto_image_viewer_value_changed (GtkAdjustment *adjustment, RsttoImageViewer *viewer)
-{
-    GtkWidget *widget = GTK_WIDGET (viewer);
-    gdk_window_invalidate_rect (gtk_widget_get_window (widget), NULL, FALSE);
+    viewer->priv->frames.done = FALSE;
+    viewer->priv->frames.due = 0;
+    viewer->priv->frames.painted = FALSE;
 }
 
+/**
+ * rstto_image_viewer_set_animation:
+ * @viewer:
+ * @animation: (nullable):
+ *
+ * Replace the displayed image with @animation.
+ */
 static void
-cb_rstto_image_viewer_read_file_ready (GObject *source_object, GAsyncResult *result, gpointer user_data)
+rstto_image_viewer_set_animation (RsttoImageViewer *viewer, GdkPixbufAnimation *animation)
 {
-    GFile *file = G_FILE (source_object);
-    RsttoImageViewerTransaction *transaction = (RsttoImageViewerTransaction *)user_data;
+    GdkPixbuf *pixbuf;
 
-    GFileInputStream *file_input_stream = g_file_read_finish (file, result, NULL);
+    rstto_image_viewer_stop_animation (viewer);
+    rstto_image_viewer_set_pixbuf (viewer, NULL);
 
-    if (file_input_stream == NULL)
+    if (viewer->priv->animation)
     {
-        return;
+        g_object_unref (viewer->priv->animation);
+        viewer->priv->animation = NULL;
     }
 
-    g_input_stream_read_async (G_INPUT_STREAM (file_input_stream),
-                               transaction->buffer,
-                               RSTTO_IMAGE_VIEWER_BUFFER_SIZE,
-                               G_PRIORITY_DEFAULT,
-                               transaction->cancellable,
-                               (GAsyncReadyCallback) cb_rstto_image_viewer_read_input_stream_ready,
-                               transaction);
-}
-
-static void
-cb_rstto_image_viewer_read_input_stream_ready (GObject *source_object, GAsyncResult *result, gpointer user_data)
-{
-    RsttoImageViewerTransaction *transaction = (RsttoImageViewerTransaction *)user_data;
-    gssize read_bytes = g_input_stream_read_finish (G_INPUT_STREAM (source_object), result, &transaction->error);
-
-    if (read_bytes == -1)
+    if (NULL == animation)
     {
-        gdk_pixbuf_loader_close (transaction->loader, NULL);
         return;
     }
 
-    if (read_bytes > 0)
+    viewer->priv->animation = g_object_ref (animation);
+
+    if (gdk_pixbuf_animation_is_static_image (animation))
     {
-        if (gdk_pixbuf_loader_write (transaction->loader, (const guchar *)transaction->buffer, read_bytes, &transaction->error) == FALSE)
-        {
-            /* Clean up the input-stream */
-            g_input_stream_close (G_INPUT_STREAM (source_object), NULL, NULL);
-            g_object_unref(source_object);
-        }
-        else
+        rstto_image_viewer_set_pixbuf (
+                viewer,
+                gdk_pixbuf_animation_get_static_image (animation));
+    }
+    else
+    {
+        /* The pixbuf does not change, until the first frame is
+         * composited it is painted in its place. The static image may
+         * be the buffer the worker-thread composites the frames into,
+         * so the main-thread paints a copy of it.
+         */
+        pixbuf = gdk_pixbuf_copy (gdk_pixbuf_animation_get_static_image (animation));
+        rstto_image_viewer_set_pixbuf (viewer, pixbuf);
+        if (NULL != pixbuf)
         {
-            g_input_stream_read_async (G_INPUT_STREAM (source_object),
-                                       transaction->buffer,
-                                       RSTTO_IMAGE_VIEWER_BUFFER_SIZE,
-                                       G_PRIORITY_DEFAULT,
-                                       transaction->cancellable,
-                                       (GAsyncReadyCallback) cb_rstto_image_viewer_read_input_stream_ready,
-                                       transaction);
+            g_object_unref (pixbuf);
         }
-    }
-    else {
-        /* Loading complete, transaction should not be free-ed */
-        gdk_pixbuf_loader_close (transaction->loader, &transaction->error);
 
-        /* Clean up the input-stream */
-        g_input_stream_close (G_INPUT_STREAM (source_object), NULL, NULL);
-        g_object_unref (source_object);
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        g_get_current_time (&viewer->priv->frames.time);
+        viewer->priv->frames.iter = gdk_pixbuf_animation_get_iter (
+                animation,
+                &viewer->priv->frames.time);
+G_GNUC_END_IGNORE_DEPRECATIONS
+        viewer->priv->frames.tick_id = gtk_widget_add_tick_callback (
+                GTK_WIDGET (viewer),
+                cb_rstto_image_viewer_animation_tick,
+                NULL,
+                NULL);
     }
 }
 
-
-static void
-cb_rstto_image_loader_image_ready (GdkPixbufLoader *loader, RsttoImageViewerTransaction *transaction)
+static gboolean
+cb_rstto_image_viewer_progress_tick (
+        GtkWidget *widget,
+        GdkFrameClock *frame_clock,
+        gpointer user_data)
 {
-    gint timeout = 0;
-    RsttoImageViewer *viewer = transaction->viewer;
-
-    if (viewer->priv->transaction == transaction)
-    {
-        if (viewer->priv->iter)
-        {
-            g_object_unref (viewer->priv->iter);
-            viewer->priv->iter = NULL;
-        }
+    RsttoImageViewer *viewer = RSTTO_IMAGE_VIEWER (widget);
+    GdkRectangle      area = viewer->priv->progress_area;
 
-        if (viewer->priv->pixbuf)
-        {
-            g_object_unref (viewer->priv->pixbuf);
-            viewer->priv->pixbuf = NULL;
-        }
+    viewer->priv->progress_tick_id = 0;
+    viewer->priv->progress_area.width = 0;
+    viewer->priv->progress_area.height = 0;
 
-        if (viewer->priv->animation)
-        {
-            g_object_unref (viewer->priv->animation);
-            viewer->priv->animation = NULL;
-        }
+    /* Nothing of the pixbuf was painted yet, so it has no tiles either */
+    if (FALSE == viewer->priv->rendering.painted)
+    {
+        gdk_window_invalidate_rect (gtk_widget_get_window (widget), NULL, FALSE);
+        return G_SOURCE_REMOVE;
+    }
 
-        viewer->priv->animation = gdk_pixbuf_loader_get_animation (loader);
-        viewer->priv->iter = gdk_pixbuf_animation_get_iter (viewer->priv->animation, NULL);
+    if (0 == area.width || 0 == area.height)
+    {
+        return G_SOURCE_REMOVE;
+    }
 
-        g_object_ref (viewer->priv->animation);
+    /* The tiles hold the pixels that were decoded when they were converted */
+    rstto_image_viewer_drop_tiles (viewer, 0, &area);
 
-        timeout = gdk_pixbuf_animation_iter_get_delay_time (viewer->priv->iter);
+    rstto_image_viewer_invalidate_area (viewer, &viewer->priv->rendering.matrix, &area);
 
-        if (timeout > 0)
-        {
-            viewer->priv->animation_timeout_id =
-                    gdk_threads_add_timeout (timeout, cb_rstto_image_viewer_update_pixbuf, viewer);
-        }
-        else
-        {
-            /* This is a single-frame image, there is no need to copy the pixbuf since it won't change */
-            viewer->priv->pixbuf = gdk_pixbuf_animation_iter_get_pixbuf (viewer->priv->iter);
-            g_object_ref (viewer->priv->pixbuf);
-        }
-    }
+    return G_SOURCE_REMOVE;
 }
 
+/**
+ * cb_rstto_image_viewer_decode_progress:
+ *
+ * Show the part of the image that has been decoded so far. The first
+ * report replaces the previous image, after that the repaints are
+ * limited to one per frame, however often the loader reports.
+ */
 static void
-cb_rstto_image_loader_size_prepared (GdkPixbufLoader *loader, gint width, gint height, RsttoImageViewerTransaction *transaction)
+cb_rstto_image_viewer_decode_progress (
+        RsttoImageDecoder *decoder,
+        GdkPixbuf *pixbuf,
+        const GdkRectangle *area,
+        gint image_width,
+        gint image_height,
+        gdouble image_scale,
+        gpointer user_data)
 {
-    gboolean limit_quality = transaction->viewer->priv->limit_quality;
-
-    /*
-     * By default, the image-size won't be limited to screen-size (since it's smaller)
-     * or, because we don't want to reduce it.
-     * Set the image_scale to 1.0 (100%)
-     */
-    transaction->image_scale = 1.0;
-
-    transaction->image_width = width;
-    transaction->image_height = height;
+    RsttoImageViewerTransaction *transaction = user_data;
+    RsttoImageViewer *viewer = transaction->viewer;
+    GtkWidget *widget = GTK_WIDGET (viewer);
 
-    if (limit_quality == TRUE)
+    if (viewer->priv->transaction != transaction)
     {
-        GdkMonitor *monitor = gdk_display_get_monitor_at_window (
-                gdk_screen_get_display (default_screen),
-                gtk_widget_get_window (GTK_WIDGET (transaction->viewer)));
-        gint s_width, s_height;
-        GdkRectangle monitor_geometry;
+        return;
+    }
 
-        gdk_monitor_get_geometry (monitor, &monitor_geometry);
-        s_width = monitor_geometry.width;
-        s_height = monitor_geometry.height;
+    if (FALSE == transaction->progressive)
+    {
+        transaction->progressive = TRUE;
+
+        gtk_widget_set_tooltip_text (widget, NULL);
+        viewer->priv->image_scale = image_scale;
+        viewer->priv->image_width = image_width;
+        viewer->priv->image_height = image_height;
+        viewer->priv->orientation = rstto_file_get_orientation (transaction->file);
+        set_scale (viewer, transaction->scale);
+
+        /* Without an animation, no mipmap is built from the partial pixbuf */
+        rstto_image_viewer_set_animation (viewer, NULL);
+        rstto_image_viewer_set_pixbuf (viewer, pixbuf);
+        viewer->priv->progress_area.width = 0;
+        viewer->priv->progress_area.height = 0;
+    }
 
-        /*
-         * Set the maximum size of the loaded image to the screen-size.
-         * TODO: Add some 'smart-stuff' here
-         */
-        if (s_width < width || s_height < height)
+    if (0 != area->width && 0 != area->height)
+    {
+        if (0 == viewer->priv->progress_area.width || 0 == viewer->priv->progress_area.height)
         {
-            /*
-             * The image is loaded at the screen_size, calculate how this fits best.
-             *  scale = MIN(width / screen_width, height / screen_height)
-             *
-             */
-            if (((gdouble)width / (gdouble)s_width) < ((gdouble)height / (gdouble)s_height))
-            {
-                transaction->image_scale = (gdouble)s_width / (gdouble)width;
-                gdk_pixbuf_loader_set_size (loader,
-                                            s_width,
-                                            (gint)((gdouble)height/(gdouble)width*(gdouble)s_width));
-            }
-            else
-            {
-                transaction->image_scale = (gdouble)s_height / (gdouble)height;
-                gdk_pixbuf_loader_set_size (loader,
-                                            (gint)((gdouble)width/(gdouble)height*(gdouble)s_height),
-                                            s_height);
-            }
+            viewer->priv->progress_area = *area;
         }
         else
         {
-            /*
-             * Image-size won't be limited to screen-size (since it's smaller)
-             * Set the image_scale to 1.0 (100%)
-             */
-            transaction->image_scale = 1.0;
+            gdk_rectangle_union (
+                    &viewer->priv->progress_area,
+                    area,
+                    &viewer->priv->progress_area);
         }
     }
 
-    transaction->orientation = rstto_file_get_orientation (transaction->file);
+    if (0 == viewer->priv->progress_tick_id)
+    {
+        viewer->priv->progress_tick_id = gtk_widget_add_tick_callback (
+                widget,
+                cb_rstto_image_viewer_progress_tick,
+                NULL,
+                NULL);
+    }
 }
 
 static void
-cb_rstto_image_loader_closed (GdkPixbufLoader *loader, RsttoImageViewerTransaction *transaction)
+cb_rstto_image_viewer_decode_ready (GObject *source_object, GAsyncResult *result, gpointer user_data)
 {
+    RsttoImageViewerTransaction *transaction = user_data;
     RsttoImageViewer *viewer = transaction->viewer;
     GtkWidget *widget = GTK_WIDGET (viewer);
+    GdkPixbufAnimation *animation;
+    RsttoImageOrientation orientation = transaction->orientation;
+    RsttoImageOrientation key_orientation;
+
+    animation = rstto_image_decoder_decode_finish (
+            RSTTO_IMAGE_DECODER (source_object),
+            result,
+            &transaction->image_width,
+            &transaction->image_height,
+            &transaction->image_scale,
+            &orientation,
+            &transaction->error);
+
+    /* The decoder turned a raw-preview upright, otherwise
+     * keep the orientation the user picked while it was loading.
+     * The cache is looked up with the orientation of the file.
+     */
+    key_orientation = rstto_file_get_orientation (transaction->file);
+    if (orientation != transaction->orientation)
+    {
+        transaction->orientation = orientation;
+    }
+    else
+    {
+        transaction->orientation = key_orientation;
+    }
+
+    /* A first, viewport-sized decode is not worth keeping */
+    if (NULL != animation &&
+        FALSE == g_cancellable_is_cancelled (transaction->cancellable) &&
+        transaction->max_width == transaction->full_width &&
+        transaction->max_height == transaction->full_height)
+    {
+        rstto_image_cache_insert (
+                viewer->priv->cache,
+                transaction->file,
+                transaction->max_width,
+                transaction->max_height,
+                key_orientation,
+                animation,
+                transaction->image_width,
+                transaction->image_height,
+                transaction->image_scale,
+                transaction->orientation);
+    }
+
+    if (viewer->priv->refinement == transaction)
+    {
+        viewer->priv->refinement = NULL;
+
+        /* On error, the first decode stays */
+        if (NULL == transaction->error)
+        {
+            viewer->priv->image_scale = transaction->image_scale;
+            viewer->priv->image_width = transaction->image_width;
+            viewer->priv->image_height = transaction->image_height;
 
-    if (viewer->priv->transaction == transaction)
+            rstto_image_viewer_set_animation (viewer, animation);
+
+            gdk_window_invalidate_rect (gtk_widget_get_window (widget), NULL, FALSE);
+        }
+    }
+    else if (viewer->priv->transaction == transaction)
     {
         if (NULL == transaction->error)
         {
@@ -2189,20 +4580,39 @@ cb_rstto_image_loader_closed (GdkPixbufLoader *loader, RsttoImageViewerTransacti
             viewer->priv->image_width = transaction->image_width;
             viewer->priv->image_height = transaction->image_height;
             viewer->priv->orientation = transaction->orientation;
-            set_scale (viewer, transaction->scale);
 
-            cb_rstto_image_loader_image_ready (loader, transaction);
+            /* Keep the zoom the user picked while the image was loading */
+            if (FALSE == transaction->progressive)
+            {
+                set_scale (viewer, transaction->scale);
+            }
+
+            rstto_image_viewer_set_animation (viewer, animation);
+
+            /* Only part of the detail was decoded */
+            if (transaction->image_scale < 1.0 &&
+                (transaction->max_width != transaction->full_width ||
+                 transaction->max_height != transaction->full_height))
+            {
+                if (viewer->priv->scale > transaction->image_scale)
+                {
+                    rstto_image_viewer_refine (viewer);
+                }
+                else
+                {
+                    viewer->priv->refine_timeout_id = g_timeout_add (
+                            RSTTO_IMAGE_VIEWER_REFINE_DELAY,
+                            cb_rstto_image_viewer_refine_timeout,
+                            viewer);
+                }
+            }
         }
         else
         {
             viewer->priv->image_scale = 1.0;
             viewer->priv->image_width = 1.0;
             viewer->priv->image_height = 1.0;
-            if (viewer->priv->pixbuf)
-            {
-                g_object_unref (viewer->priv->pixbuf);
-                viewer->priv->pixbuf = NULL;
-            }
+            rstto_image_viewer_set_pixbuf (viewer, NULL);
 
             gtk_widget_set_tooltip_text (widget, transaction->error->message);
         }
@@ -2214,48 +4624,13 @@ cb_rstto_image_loader_closed (GdkPixbufLoader *loader, RsttoImageViewerTransacti
         gdk_window_invalidate_rect (gtk_widget_get_window (widget), NULL, FALSE);
     }
 
-    g_signal_emit_by_name (transaction->viewer, "size-ready");
-    rstto_image_viewer_transaction_free (transaction);
-}
-
-static gboolean
-cb_rstto_image_viewer_update_pixbuf (gpointer user_data)
-{
-    RsttoImageViewer *viewer = user_data;
-    GtkWidget *widget = GTK_WIDGET (viewer);
-    gint timeout = 0;
-
-    if (viewer->priv->iter)
+    if (NULL != animation)
     {
-        if (gdk_pixbuf_animation_iter_advance (viewer->priv->iter, NULL))
-        {
-            /* Cleanup old image */
-            if (viewer->priv->pixbuf)
-            {
-                g_object_unref (viewer->priv->pixbuf);
-                viewer->priv->pixbuf = NULL;
-            }
-
-            /* The pixbuf returned by the GdkPixbufAnimationIter might be reused, 
-             * lets make a copy for myself just in case. Since it's a copy, we
-             * own the only reference to it. There is no need to add another.
-             */
-            viewer->priv->pixbuf = gdk_pixbuf_copy (gdk_pixbuf_animation_iter_get_pixbuf (viewer->priv->iter));
-        }
-
-        timeout = gdk_pixbuf_animation_iter_get_delay_time (viewer->priv->iter);
-
-        if (timeout > 0)
-        {
-            viewer->priv->animation_timeout_id =
-                    gdk_threads_add_timeout(timeout, cb_rstto_image_viewer_update_pixbuf, viewer);
-        }
-
-        gdk_window_invalidate_rect (gtk_widget_get_window (widget), NULL, FALSE);
-
-        return FALSE;
+        g_object_unref (animation);
     }
-    return FALSE;
+
+    g_signal_emit_by_name (transaction->viewer, "size-ready");
+    rstto_image_viewer_transaction_free (transaction);
 }
 
 static gboolean
@@ -2279,6 +4654,8 @@ rstto_scroll_event (GtkWidget *widget, GdkEventScroll *event)
         {
             viewer->priv->auto_scale = FALSE;
 
+            rstto_image_viewer_interact (viewer);
+
             tmp_x = (gdouble)(gtk_adjustment_get_value(viewer->hadjustment) + 
                     (gdouble)event->x - x_offset) / viewer->priv->scale;
             tmp_y = (gdouble)(gtk_adjustment_get_value(viewer->vadjustment) + 
@@ -2499,15 +4876,9 @@ rstto_motion_notify_event (GtkWidget *widget, GdkEventMotion *event)
                 }
                 break;
             case RSTTO_IMAGE_VIEWER_MOTION_STATE_BOX_ZOOM:
-                /* TODO: Calculate the rectangle to invalidate.
-                 * 
-                 * It should be a rectangle covering both the original
-                 * selection-box and the new one.
-                 */
-                gdk_window_invalidate_rect (
-                        gtk_widget_get_window (widget),
-                        NULL,
-                        FALSE); 
+                rstto_image_viewer_update_overlay (
+                        viewer,
+                        RSTTO_IMAGE_VIEWER_OVERLAY_SELECTION_BOX);
 
                 /* Only change the cursor when hovering over the image
                  */
@@ -2986,12 +5357,10 @@ static gboolean
 cb_rstto_image_viewer_refresh (gpointer user_data)
 {
     RsttoImageViewer *viewer = user_data;
-    GtkWidget *widget = GTK_WIDGET (viewer);
 
-    gdk_window_invalidate_rect (
-            gtk_widget_get_window (widget),
-            NULL,
-            FALSE);
+    rstto_image_viewer_update_overlay (
+            viewer,
+            RSTTO_IMAGE_VIEWER_OVERLAY_CLOCK);
 
     return TRUE;
 }
@@ -3012,6 +5381,10 @@ rstto_image_viewer_set_show_clock (RsttoImageViewer *viewer, gboolean value)
             REMOVE_SOURCE (viewer->priv->refresh_timeout_id);
         }
     }
+
+    rstto_image_viewer_update_overlay (
+            viewer,
+            RSTTO_IMAGE_VIEWER_OVERLAY_CLOCK);
 }
 
 gboolean
@@ -3027,6 +5400,9 @@ rstto_image_viewer_is_busy (RsttoImageViewer *viewer )
 static void
 cb_rstto_image_viewer_file_changed (RsttoFile *r_file, RsttoImageViewer *viewer )
 {
+    /* The cache may not have seen the change yet */
+    rstto_image_cache_remove_file (viewer->priv->cache, r_file);
+
     rstto_image_viewer_load_image (
             viewer,
             r_file,
@@ -3034,3 +5410,92 @@ cb_rstto_image_viewer_file_changed (RsttoFile *r_file, RsttoImageViewer *viewer
 
     g_signal_emit_by_name(viewer, "status-changed");
 }
+
+static void
+cb_rstto_image_viewer_cache_ready (
+        RsttoImageCache *cache,
+        RsttoFile *r_file,
+        RsttoImageViewer *viewer)
+{
+    RsttoImageViewerTransaction *transaction = viewer->priv->transaction;
+    GdkPixbufAnimation          *animation;
+    gint                         image_width, image_height;
+    gdouble                      image_scale;
+    RsttoImageOrientation        image_orientation;
+
+    if (NULL == transaction || transaction->file != r_file)
+    {
+        return;
+    }
+
+    /* The image that is being loaded was prefetched meanwhile,
+     * take it from the cache instead of waiting for the decoder.
+     */
+    animation = rstto_image_cache_lookup (
+            cache,
+            r_file,
+            transaction->full_width,
+            transaction->full_height,
+            rstto_file_get_orientation (r_file),
+            &image_width,
+            &image_height,
+            &image_scale,
+            &image_orientation);
+    if (NULL != animation)
+    {
+        g_object_unref (animation);
+        rstto_image_viewer_load_image (viewer, r_file, transaction->scale);
+    }
+}
+
+/**
+ * cb_rstto_image_viewer_metadata_ready:
+ * @reader:
+ * @r_file:
+ * @viewer:
+ *
+ * Show the EXIF thumbnail of the image that is being loaded,
+ * unless part of the image itself was painted already.
+ */
+static void
+cb_rstto_image_viewer_metadata_ready (
+        RsttoMetadataReader *reader,
+        RsttoFile *r_file,
+        RsttoImageViewer *viewer)
+{
+    RsttoImageViewerTransaction *transaction = viewer->priv->transaction;
+
+    if (NULL == transaction ||
+        transaction->file != r_file ||
+        transaction->placeholder ||
+        transaction->progressive)
+    {
+        return;
+    }
+
+    rstto_image_viewer_show_placeholder (viewer, transaction);
+}
+
+/**
+ * rstto_image_viewer_prefetch:
+ * @viewer:
+ * @files: The files that are likely to be shown next, most likely first
+ *
+ * Decode @files in the background, so they can be shown
+ * without delay.
+ */
+void
+rstto_image_viewer_prefetch (
+        RsttoImageViewer *viewer,
+        GList *files)
+{
+    gint max_width, max_height;
+
+    rstto_image_viewer_get_decode_size (viewer, &max_width, &max_height);
+
+    rstto_image_cache_set_prefetch (
+            viewer->priv->cache,
+            files,
+            max_width,
+            max_height);
+}
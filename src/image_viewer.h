@@ -124,6 +124,11 @@ gboolean
 rstto_image_viewer_is_busy (
         RsttoImageViewer *viewer );
 
+void
+rstto_image_viewer_prefetch (
+        RsttoImageViewer *viewer,
+        GList *files);
+
 
 G_END_DECLS
 
@@ -55,6 +55,15 @@
 #define RSTTO_RECENT_FILES_APP_NAME "ristretto"
 #define RSTTO_RECENT_FILES_GROUP "Graphics"
 
+/* Number of images to decode ahead, in both directions */
+#ifndef RSTTO_PREFETCH_NEXT
+#define RSTTO_PREFETCH_NEXT 2
+#endif
+
+#ifndef RSTTO_PREFETCH_PREVIOUS
+#define RSTTO_PREFETCH_PREVIOUS 1
+#endif
+
 enum
 {
     EDITOR_CHOOSER_MODEL_COLUMN_NAME = 0,
@@ -171,6 +180,8 @@ rstto_main_window_save_geometry_timer_destroy (gpointer user_data);
 
 static void
 rstto_main_window_image_list_iter_changed (RsttoMainWindow *window);
+static void
+rstto_main_window_prefetch (RsttoMainWindow *window, RsttoFile *cur_file);
 
 static gboolean
 rstto_main_window_add_file_to_recent_files_cb (gpointer user_data);
@@ -1413,6 +1424,53 @@ rstto_main_window_new (RsttoImageList *image_list, gboolean fullscreen)
     return GTK_WIDGET (window);
 }
 
+/**
+ * rstto_main_window_prefetch:
+ * @window:
+ * @cur_file: The file that is displayed
+ *
+ * Let the image-viewer decode the images surrounding
+ * the iterator, so next/previous can show them right away.
+ */
+static void
+rstto_main_window_prefetch (RsttoMainWindow *window, RsttoFile *cur_file)
+{
+    RsttoImageListIter *next_iter = rstto_image_list_iter_clone (window->priv->iter);
+    RsttoImageListIter *prev_iter = rstto_image_list_iter_clone (window->priv->iter);
+    RsttoFile          *file;
+    GList              *files = NULL;
+    gint                i;
+
+    /* Alternate between both directions, the closest images first */
+    for (i = 0; i < MAX (RSTTO_PREFETCH_NEXT, RSTTO_PREFETCH_PREVIOUS); ++i)
+    {
+        if (i < RSTTO_PREFETCH_NEXT && rstto_image_list_iter_has_next (next_iter))
+        {
+            rstto_image_list_iter_next (next_iter);
+            file = rstto_image_list_iter_get_file (next_iter);
+            if (NULL != file && file != cur_file && NULL == g_list_find (files, file))
+            {
+                files = g_list_append (files, file);
+            }
+        }
+        if (i < RSTTO_PREFETCH_PREVIOUS && rstto_image_list_iter_has_previous (prev_iter))
+        {
+            rstto_image_list_iter_previous (prev_iter);
+            file = rstto_image_list_iter_get_file (prev_iter);
+            if (NULL != file && file != cur_file && NULL == g_list_find (files, file))
+            {
+                files = g_list_append (files, file);
+            }
+        }
+    }
+
+    rstto_image_viewer_prefetch (RSTTO_IMAGE_VIEWER (window->priv->image_viewer), files);
+
+    g_list_free (files);
+    g_object_unref (next_iter);
+    g_object_unref (prev_iter);
+}
+
 /**
  * rstto_main_window_image_list_iter_changed:
  * @window:
@@ -1451,9 +1509,10 @@ G_GNUC_END_IGNORE_DEPRECATIONS
         {
             rstto_icon_bar_set_active (RSTTO_ICON_BAR (window->priv->thumbnailbar), position);
             rstto_icon_bar_show_active (RSTTO_ICON_BAR (window->priv->thumbnailbar));
-            content_type  = rstto_file_get_content_type (cur_file);
+            content_type  = rstto_file_get_known_content_type (cur_file);
 
             rstto_image_viewer_set_file (RSTTO_IMAGE_VIEWER (window->priv->image_viewer), cur_file, -1.0, 0);
+            rstto_main_window_prefetch (window, cur_file);
 
             pixbuf = rstto_file_get_thumbnail (cur_file, THUMBNAIL_SIZE_SMALL);
             if (pixbuf != NULL)
@@ -1582,6 +1641,8 @@ rstto_main_window_update_statusbar (RsttoMainWindow *window)
     RsttoFile *cur_file = NULL;
     RsttoImageViewer *viewer = RSTTO_IMAGE_VIEWER(window->priv->image_viewer);
     ExifEntry *exif_entry = NULL;
+    guint n_scanned = 0;
+    guint n_estimated = 0;
     gchar exif_data[20];
     GError *error = NULL;
 
@@ -1670,8 +1731,22 @@ rstto_main_window_update_statusbar (RsttoMainWindow *window)
             status = g_strdup (_("Press open to select an image"));
         }
 
-        if ( rstto_image_viewer_is_busy (viewer) ||
-             rstto_image_list_is_busy (window->priv->image_list) )
+        if ( rstto_image_list_get_progress (window->priv->image_list, &n_scanned, &n_estimated) )
+        {
+            if (status)
+            {
+                g_free (status);
+            }
+            if ( n_estimated > n_scanned )
+            {
+                status = g_strdup_printf (_("Loading... (%u of ~%u)"), n_scanned, n_estimated);
+            }
+            else
+            {
+                status = g_strdup_printf (_("Loading... (%u)"), n_scanned);
+            }
+        }
+        else if ( rstto_image_viewer_is_busy (viewer) )
         {
             if (status)
             {
@@ -3662,7 +3737,7 @@ cb_rstto_main_window_edit (
         RsttoMainWindow *window)
 {
     RsttoFile       *r_file = rstto_image_list_iter_get_file(window->priv->iter);
-    const gchar     *content_type = rstto_file_get_content_type (r_file);
+    const gchar     *content_type = rstto_file_get_known_content_type (r_file);
     const gchar     *editor = rstto_mime_db_lookup (window->priv->db, content_type);
     GList           *files = g_list_prepend (NULL, rstto_file_get_file (r_file));
     GDesktopAppInfo *app_info = NULL;
@@ -3849,7 +3924,7 @@ rstto_main_window_is_valid_image (RsttoMainWindow *window,
 
     filter_info.contains =  GTK_FILE_FILTER_MIME_TYPE | GTK_FILE_FILTER_URI;
     filter_info.uri = rstto_file_get_uri (file);
-    filter_info.mime_type = rstto_file_get_content_type (file);
+    filter_info.mime_type = rstto_file_get_known_content_type (file);
 
     return gtk_file_filter_filter (window->priv->filter, &filter_info);
 }
@@ -4126,7 +4201,7 @@ rstto_main_window_launch_editor_chooser (
         RsttoMainWindow *window)
 {
     RsttoFile *r_file = rstto_image_list_iter_get_file(window->priv->iter);
-    const gchar *content_type = rstto_file_get_content_type (r_file);
+    const gchar *content_type = rstto_file_get_known_content_type (r_file);
     GList *files = g_list_prepend (NULL, rstto_file_get_file (r_file));
     GList *app_infos_all = NULL;
     GList *app_infos_recommended = NULL;
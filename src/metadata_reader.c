@@ -0,0 +1,680 @@
+/*
+ *  Copyright (c) Stephan Arts 2006-2012 <stephan@xfce.org>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <libexif/exif-data.h>
+
+#include "util.h"
+#include "file.h"
+#include "metadata_reader.h"
+
+/* Maximum number of threads reading metadata */
+#ifndef RSTTO_METADATA_READER_MAX_THREADS
+#define RSTTO_METADATA_READER_MAX_THREADS 4
+#endif
+
+/* Maximum number of JPEG segments to look at
+ * before giving up on a file.
+ */
+#ifndef RSTTO_METADATA_READER_MAX_SEGMENTS
+#define RSTTO_METADATA_READER_MAX_SEGMENTS 64
+#endif
+
+static void
+rstto_metadata_reader_init (GObject *);
+static void
+rstto_metadata_reader_class_init (GObjectClass *);
+
+static void
+rstto_metadata_reader_dispose (GObject *object);
+static void
+rstto_metadata_reader_finalize (GObject *object);
+
+static void
+rstto_metadata_reader_thread (
+        gpointer data,
+        gpointer user_data);
+static gboolean
+cb_rstto_metadata_reader_results_ready (gpointer user_data);
+
+static GObjectClass *parent_class = NULL;
+
+static RsttoMetadataReader *metadata_reader_object;
+
+enum
+{
+    RSTTO_METADATA_READER_SIGNAL_READY = 0,
+    RSTTO_METADATA_READER_SIGNAL_COUNT
+};
+
+static gint rstto_metadata_reader_signals[RSTTO_METADATA_READER_SIGNAL_COUNT];
+
+GType
+rstto_metadata_reader_get_type (void)
+{
+    static GType rstto_metadata_reader_type = 0;
+
+    if (!rstto_metadata_reader_type)
+    {
+        static const GTypeInfo rstto_metadata_reader_info = 
+        {
+            sizeof (RsttoMetadataReaderClass),
+            (GBaseInitFunc) NULL,
+            (GBaseFinalizeFunc) NULL,
+            (GClassInitFunc) rstto_metadata_reader_class_init,
+            (GClassFinalizeFunc) NULL,
+            NULL,
+            sizeof (RsttoMetadataReader),
+            0,
+            (GInstanceInitFunc) rstto_metadata_reader_init,
+            NULL
+        };
+
+        rstto_metadata_reader_type = g_type_register_static (
+                G_TYPE_OBJECT,
+                "RsttoMetadataReader",
+                &rstto_metadata_reader_info,
+                0);
+    }
+    return rstto_metadata_reader_type;
+}
+
+struct _RsttoMetadataReaderPriv
+{
+    GThreadPool *pool;
+
+    /* Files that are queued, or being read,
+     * mapped to the last RsttoMetadataJob queued for them.
+     */
+    GHashTable  *pending;
+
+    /* Queue of RsttoMetadataJob, filled by the worker-threads */
+    GAsyncQueue *results;
+    gint         idle_pending;
+
+    /* Set while the reader is disposed, the worker-threads
+     * only pass the remaining jobs on to be freed.
+     */
+    gint         stopping;
+};
+
+typedef struct _RsttoMetadataJob RsttoMetadataJob;
+
+struct _RsttoMetadataJob
+{
+    RsttoMetadataReader *reader;
+    RsttoMetadataFlags   flags;
+    /* The flags of this job, and of the
+     * jobs for the same file still queued.
+     */
+    RsttoMetadataFlags   covered;
+    GCancellable        *cancellable;
+    RsttoFile           *file;
+    GFile               *g_file;
+    gchar               *path;
+
+    RsttoFileMetadata    metadata;
+    gchar               *content_type;
+    GdkPixbuf           *thumbnail;
+};
+
+static void
+rstto_metadata_reader_init (GObject *object)
+{
+    RsttoMetadataReader *reader = RSTTO_METADATA_READER (object);
+
+    reader->priv = g_new0 (RsttoMetadataReaderPriv, 1);
+    reader->priv->pending = g_hash_table_new (g_direct_hash, g_direct_equal);
+    reader->priv->results = g_async_queue_new ();
+    reader->priv->pool = g_thread_pool_new (
+            rstto_metadata_reader_thread,
+            reader,
+            MIN (RSTTO_METADATA_READER_MAX_THREADS, (gint) g_get_num_processors ()),
+            FALSE,
+            NULL);
+}
+
+
+static void
+rstto_metadata_reader_class_init (GObjectClass *object_class)
+{
+    RsttoMetadataReaderClass *reader_class = RSTTO_METADATA_READER_CLASS (
+            object_class);
+
+    parent_class = g_type_class_peek_parent (reader_class);
+
+    object_class->dispose = rstto_metadata_reader_dispose;
+    object_class->finalize = rstto_metadata_reader_finalize;
+
+    rstto_metadata_reader_signals[RSTTO_METADATA_READER_SIGNAL_READY] = g_signal_new("ready",
+            G_TYPE_FROM_CLASS(reader_class),
+            G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+            0,
+            NULL,
+            NULL,
+            g_cclosure_marshal_VOID__OBJECT,
+            G_TYPE_NONE,
+            1,
+            G_TYPE_OBJECT,
+            NULL);
+}
+
+static void
+rstto_metadata_job_free (RsttoMetadataJob *job)
+{
+    g_object_unref (job->file);
+    g_object_unref (job->g_file);
+    if (job->cancellable)
+    {
+        g_object_unref (job->cancellable);
+    }
+    g_free (job->path);
+    g_free (job->content_type);
+    if (job->thumbnail)
+    {
+        g_object_unref (job->thumbnail);
+    }
+    g_free (job);
+}
+
+/**
+ * rstto_metadata_reader_dispose:
+ * @object:
+ *
+ */
+static void
+rstto_metadata_reader_dispose (GObject *object)
+{
+    RsttoMetadataReader *reader = RSTTO_METADATA_READER (object);
+    RsttoMetadataJob    *job;
+
+    if (reader->priv)
+    {
+        /* Let the queued jobs pass through the worker-threads without
+         * reading anything, dropping them would leak them.
+         */
+        g_atomic_int_set (&reader->priv->stopping, 1);
+        g_thread_pool_free (reader->priv->pool, FALSE, TRUE);
+
+        while (NULL != (job = g_async_queue_try_pop (reader->priv->results)))
+        {
+            rstto_metadata_job_free (job);
+        }
+        g_async_queue_unref (reader->priv->results);
+        g_hash_table_destroy (reader->priv->pending);
+
+        g_clear_pointer (&reader->priv, g_free);
+    }
+}
+
+/**
+ * rstto_metadata_reader_finalize:
+ * @object:
+ *
+ */
+static void
+rstto_metadata_reader_finalize (GObject *object)
+{
+}
+
+
+
+/**
+ * rstto_metadata_reader_new:
+ *
+ *
+ * Singleton
+ */
+RsttoMetadataReader *
+rstto_metadata_reader_new (void)
+{
+    if (metadata_reader_object == NULL)
+    {
+        metadata_reader_object = g_object_new (RSTTO_TYPE_METADATA_READER, NULL);
+        g_object_add_weak_pointer (
+                G_OBJECT (metadata_reader_object),
+                (gpointer *) &metadata_reader_object);
+    }
+    else
+    {
+        g_object_ref (metadata_reader_object);
+    }
+
+    return metadata_reader_object;
+}
+
+/**
+ * rstto_metadata_reader_queue_file:
+ * @reader:
+ * @file:
+ * @flags: The metadata to read
+ * @cancellable: (allow-none): Skips the job once cancelled
+ *
+ * Read the metadata of @file in the background, the "ready"
+ * signal is emitted once it is stored in @file.
+ *
+ * Jobs whose @cancellable is cancelled are skipped before
+ * anything is read, and no signal is emitted for them.
+ */
+void
+rstto_metadata_reader_queue_file (
+        RsttoMetadataReader *reader,
+        RsttoFile *file,
+        RsttoMetadataFlags flags,
+        GCancellable *cancellable)
+{
+    RsttoMetadataJob   *job;
+    RsttoMetadataJob   *last;
+    RsttoMetadataFlags  pending = 0;
+
+    g_return_if_fail ( RSTTO_IS_METADATA_READER (reader) );
+
+    g_return_if_fail ( RSTTO_IS_FILE (file) );
+
+    /* Skip what is known, or already requested */
+    if ( NULL != rstto_file_get_metadata (file) )
+    {
+        flags &= ~RSTTO_METADATA_EXIF;
+    }
+    if ( TRUE == rstto_file_has_content_type (file) )
+    {
+        flags &= ~RSTTO_METADATA_CONTENT_TYPE;
+    }
+    if ( TRUE == rstto_file_has_exif_thumbnail (file) )
+    {
+        flags &= ~RSTTO_METADATA_EXIF_THUMBNAIL;
+    }
+#if !HAVE_MAGIC_H
+    /* Without libmagic there is nothing to sniff */
+    flags &= ~RSTTO_METADATA_CONTENT_TYPE;
+#endif
+
+    /* Jobs that were cancelled do not count, they
+     * will not store anything in @file.
+     */
+    last = g_hash_table_lookup (reader->priv->pending, file);
+    if ( NULL != last &&
+         FALSE == g_cancellable_is_cancelled (last->cancellable) )
+    {
+        pending = last->covered;
+    }
+    flags &= ~pending;
+
+    if ( 0 == flags )
+    {
+        return;
+    }
+
+    job = g_new0 (RsttoMetadataJob, 1);
+    job->reader = reader;
+    job->flags = flags;
+    job->covered = pending | flags;
+    if ( NULL != cancellable )
+    {
+        job->cancellable = g_object_ref (cancellable);
+    }
+    job->file = g_object_ref (file);
+    job->g_file = g_object_ref (rstto_file_get_file (file));
+    job->path = g_strdup (rstto_file_get_path (file));
+
+    g_hash_table_insert (reader->priv->pending, file, job);
+
+    g_thread_pool_push (reader->priv->pool, job, NULL);
+}
+
+/**
+ * rstto_metadata_reader_load_thumbnail:
+ * @data: The thumbnail embedded in the exif-block
+ * @size:
+ *
+ * Return value: (transfer full): The decoded thumbnail,
+ *               or NULL if it can not be decoded.
+ */
+static GdkPixbuf *
+rstto_metadata_reader_load_thumbnail (
+        const guchar *data,
+        guint size)
+{
+    GdkPixbufLoader *loader;
+    GdkPixbuf       *pixbuf = NULL;
+
+    loader = gdk_pixbuf_loader_new ();
+    if ( gdk_pixbuf_loader_write (loader, data, size, NULL) )
+    {
+        if ( gdk_pixbuf_loader_close (loader, NULL) )
+        {
+            pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+        }
+    }
+    else
+    {
+        gdk_pixbuf_loader_close (loader, NULL);
+    }
+
+    if ( NULL != pixbuf )
+    {
+        g_object_ref (pixbuf);
+    }
+    g_object_unref (loader);
+
+    return pixbuf;
+}
+
+/**
+ * rstto_metadata_reader_parse_exif:
+ * @metadata:
+ * @thumbnail: (out) (allow-none): The embedded thumbnail, if it is wanted
+ * @data: Contents of the APP1 segment
+ * @size:
+ *
+ * Fill @metadata with the fields of the exif-block in @data.
+ */
+static void
+rstto_metadata_reader_parse_exif (
+        RsttoFileMetadata *metadata,
+        GdkPixbuf **thumbnail,
+        const guchar *data,
+        guint size)
+{
+    ExifData  *exif_data;
+    ExifEntry *exif_entry;
+    GDateTime *date_time;
+    gchar      date[20];
+    gint       year, month, day, hour, minute, second;
+
+    exif_data = exif_data_new_from_data (data, size);
+    if ( NULL == exif_data )
+    {
+        return;
+    }
+
+    exif_entry = exif_data_get_entry (exif_data, EXIF_TAG_DATE_TIME_ORIGINAL);
+    if ( NULL == exif_entry )
+    {
+        exif_entry = exif_data_get_entry (exif_data, EXIF_TAG_DATE_TIME);
+    }
+    if ( NULL != exif_entry && exif_entry->format == EXIF_FORMAT_ASCII )
+    {
+        /* The format is "YYYY:MM:DD HH:MM:SS" */
+        memset (date, 0, sizeof (date));
+        memcpy (date, exif_entry->data, MIN (exif_entry->size, sizeof (date) - 1));
+
+        if ( sscanf (date, "%d:%d:%d %d:%d:%d",
+                     &year, &month, &day, &hour, &minute, &second) == 6 )
+        {
+            date_time = g_date_time_new_local (year, month, day, hour, minute, second);
+            if ( NULL != date_time )
+            {
+                metadata->date_taken = g_date_time_to_unix (date_time);
+                g_date_time_unref (date_time);
+            }
+        }
+    }
+
+    exif_entry = exif_data_get_entry (exif_data, EXIF_TAG_ORIENTATION);
+    if ( NULL != exif_entry && exif_entry->format == EXIF_FORMAT_SHORT )
+    {
+        metadata->orientation = exif_get_short (
+                exif_entry->data,
+                exif_data_get_byte_order (exif_data));
+    }
+
+    if ( NULL != thumbnail && NULL != exif_data->data && 0 != exif_data->size )
+    {
+        *thumbnail = rstto_metadata_reader_load_thumbnail (exif_data->data, exif_data->size);
+    }
+
+    exif_data_unref (exif_data);
+}
+
+/**
+ * rstto_metadata_reader_read_jpeg:
+ * @stream:
+ * @metadata:
+ * @thumbnail: (out) (allow-none): The embedded thumbnail, if it is wanted
+ *
+ * Walk the segments of a JPEG file up to the image-data. Only
+ * the APP1 segment and the frame header are read, all other
+ * segments are skipped.
+ */
+static void
+rstto_metadata_reader_read_jpeg (
+        GInputStream *stream,
+        RsttoFileMetadata *metadata,
+        GdkPixbuf **thumbnail)
+{
+    guchar   header[4];
+    guchar   frame[5];
+    guchar  *segment;
+    gsize    bytes_read;
+    gsize    length;
+    gboolean have_exif = FALSE;
+    gboolean have_frame = FALSE;
+    gint     n_segments;
+
+    if ( FALSE == g_input_stream_read_all (stream, header, 2, &bytes_read, NULL, NULL) ||
+         bytes_read != 2 ||
+         header[0] != 0xFF || header[1] != 0xD8 )
+    {
+        /* Not a JPEG file */
+        return;
+    }
+
+    for (n_segments = 0;
+         n_segments < RSTTO_METADATA_READER_MAX_SEGMENTS && !(have_exif && have_frame);
+         ++n_segments)
+    {
+        if ( FALSE == g_input_stream_read_all (stream, header, 4, &bytes_read, NULL, NULL) ||
+             bytes_read != 4 ||
+             header[0] != 0xFF )
+        {
+            return;
+        }
+
+        /* Start of scan or end of image, no more headers */
+        if ( header[1] == 0xDA || header[1] == 0xD9 )
+        {
+            return;
+        }
+
+        length = (header[2] << 8) + header[3];
+        if ( length < 2 )
+        {
+            return;
+        }
+        length -= 2;
+
+        if ( header[1] == 0xE1 && FALSE == have_exif && length > 6 )
+        {
+            segment = g_malloc (length);
+            if ( FALSE == g_input_stream_read_all (stream, segment, length, &bytes_read, NULL, NULL) ||
+                 bytes_read != length )
+            {
+                g_free (segment);
+                return;
+            }
+
+            /* There can be an APP1 segment with XMP data as well */
+            if ( memcmp (segment, "Exif\0\0", 6) == 0 )
+            {
+                rstto_metadata_reader_parse_exif (metadata, thumbnail, segment, length);
+                have_exif = TRUE;
+            }
+            g_free (segment);
+        }
+        else if ( header[1] >= 0xC0 && header[1] <= 0xCF &&
+                  header[1] != 0xC4 && header[1] != 0xC8 && header[1] != 0xCC &&
+                  length >= 5 )
+        {
+            /* Frame header: precision, height, width */
+            if ( FALSE == g_input_stream_read_all (stream, frame, 5, &bytes_read, NULL, NULL) ||
+                 bytes_read != 5 )
+            {
+                return;
+            }
+            metadata->height = (frame[1] << 8) + frame[2];
+            metadata->width = (frame[3] << 8) + frame[4];
+
+            if ( g_input_stream_skip (stream, length - 5, NULL, NULL) != (gssize) (length - 5) )
+            {
+                return;
+            }
+            have_frame = TRUE;
+        }
+        else
+        {
+            if ( g_input_stream_skip (stream, length, NULL, NULL) != (gssize) length )
+            {
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * rstto_metadata_reader_thread:
+ * @data: The job
+ * @user_data: The metadata-reader
+ *
+ * Read the metadata of a single file, runs in a worker-thread.
+ * Every worker-thread keeps its own magic cookie loaded.
+ * It does not touch the RsttoFile, only the job.
+ */
+static void
+rstto_metadata_reader_thread (
+        gpointer data,
+        gpointer user_data)
+{
+    RsttoMetadataJob    *job = data;
+    RsttoMetadataReader *reader = user_data;
+    GFileInputStream    *stream;
+
+    if ( g_atomic_int_get (&reader->priv->stopping) )
+    {
+        /* The reader is being disposed, it frees the results */
+        g_async_queue_push (reader->priv->results, job);
+        return;
+    }
+
+    /* The job is handed back without reading anything,
+     * the main-loop only has to free it.
+     */
+    if ( g_cancellable_is_cancelled (job->cancellable) )
+    {
+        job->flags = 0;
+    }
+
+    if ( job->flags & RSTTO_METADATA_CONTENT_TYPE )
+    {
+        job->content_type = rstto_file_sniff_content_type (job->path);
+    }
+
+    /* The thumbnail is decoded here as well, so the
+     * main-loop does not have to read or decode anything.
+     */
+    if ( job->flags & (RSTTO_METADATA_EXIF | RSTTO_METADATA_EXIF_THUMBNAIL) )
+    {
+        stream = g_file_read (job->g_file, NULL, NULL);
+        if ( NULL != stream )
+        {
+            rstto_metadata_reader_read_jpeg (
+                    G_INPUT_STREAM (stream),
+                    &job->metadata,
+                    (job->flags & RSTTO_METADATA_EXIF_THUMBNAIL) ? &job->thumbnail : NULL);
+            g_object_unref (stream);
+        }
+    }
+
+    g_async_queue_push (reader->priv->results, job);
+
+    /* Only schedule a new idle-handler if there is none
+     * pending, it takes all results from the queue.
+     */
+    if (g_atomic_int_compare_and_exchange (&reader->priv->idle_pending, 0, 1))
+    {
+        gdk_threads_add_idle_full (
+                G_PRIORITY_DEFAULT_IDLE,
+                cb_rstto_metadata_reader_results_ready,
+                g_object_ref (reader),
+                g_object_unref);
+    }
+}
+
+static gboolean
+cb_rstto_metadata_reader_results_ready (gpointer user_data)
+{
+    RsttoMetadataReader *reader = user_data;
+    RsttoMetadataJob    *job;
+
+    /* The reader is being disposed */
+    if ( NULL == reader->priv )
+    {
+        return FALSE;
+    }
+
+    g_atomic_int_set (&reader->priv->idle_pending, 0);
+
+    while (NULL != (job = g_async_queue_try_pop (reader->priv->results)))
+    {
+        if ( job == g_hash_table_lookup (reader->priv->pending, job->file) )
+        {
+            g_hash_table_remove (reader->priv->pending, job->file);
+        }
+
+        /* Cancelled after it was read, or before */
+        if ( 0 == job->flags ||
+             g_cancellable_is_cancelled (job->cancellable) )
+        {
+            rstto_metadata_job_free (job);
+            continue;
+        }
+
+        if ( job->flags & RSTTO_METADATA_EXIF )
+        {
+            rstto_file_set_metadata (job->file, &job->metadata);
+        }
+        if ( job->flags & RSTTO_METADATA_CONTENT_TYPE )
+        {
+            rstto_file_set_content_type (job->file, job->content_type);
+            job->content_type = NULL;
+        }
+        if ( job->flags & RSTTO_METADATA_EXIF_THUMBNAIL )
+        {
+            rstto_file_set_exif_thumbnail (job->file, job->thumbnail);
+        }
+
+        g_signal_emit (
+                G_OBJECT (reader),
+                rstto_metadata_reader_signals[RSTTO_METADATA_READER_SIGNAL_READY],
+                0,
+                job->file,
+                NULL);
+
+        rstto_metadata_job_free (job);
+    }
+
+    return FALSE;
+}
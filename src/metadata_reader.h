@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) Stephan Arts 2006-2012 <stephan@xfce.org>
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ * 
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ *  02110-1301, USA.
+ */
+
+#ifndef __RISTRETTO_METADATA_READER_H__
+#define __RISTRETTO_METADATA_READER_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define RSTTO_TYPE_METADATA_READER rstto_metadata_reader_get_type()
+
+#define RSTTO_METADATA_READER(obj)( \
+        G_TYPE_CHECK_INSTANCE_CAST ((obj), \
+                RSTTO_TYPE_METADATA_READER, \
+                RsttoMetadataReader))
+
+#define RSTTO_IS_METADATA_READER(obj)( \
+        G_TYPE_CHECK_INSTANCE_TYPE ((obj), \
+                RSTTO_TYPE_METADATA_READER))
+
+#define RSTTO_METADATA_READER_CLASS(klass)( \
+        G_TYPE_CHECK_CLASS_CAST ((klass), \
+                RSTTO_TYPE_METADATA_READER, \
+                RsttoMetadataReaderClass))
+
+#define RSTTO_IS_METADATA_READER_CLASS(klass)( \
+        G_TYPE_CHECK_CLASS_TYPE ((klass), \
+                RSTTO_TYPE_METADATA_READER()))
+
+
+typedef enum
+{
+    RSTTO_METADATA_EXIF           = 1 << 0,
+    RSTTO_METADATA_CONTENT_TYPE   = 1 << 1,
+    RSTTO_METADATA_EXIF_THUMBNAIL = 1 << 2
+} RsttoMetadataFlags;
+
+typedef struct _RsttoMetadataReader RsttoMetadataReader;
+typedef struct _RsttoMetadataReaderPriv RsttoMetadataReaderPriv;
+
+struct _RsttoMetadataReader
+{
+    GObject parent;
+
+    RsttoMetadataReaderPriv *priv;
+};
+
+typedef struct _RsttoMetadataReaderClass RsttoMetadataReaderClass;
+
+struct _RsttoMetadataReaderClass
+{
+    GObjectClass parent_class;
+};
+
+RsttoMetadataReader *
+rstto_metadata_reader_new (void);
+
+GType
+rstto_metadata_reader_get_type (void);
+
+void
+rstto_metadata_reader_queue_file (
+        RsttoMetadataReader *reader,
+        RsttoFile *file,
+        RsttoMetadataFlags flags,
+        GCancellable *cancellable);
+
+G_END_DECLS
+
+#endif /* __RISTRETTO_METADATA_READER_H__ */
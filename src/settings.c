@@ -63,6 +63,7 @@ enum
     PROP_SHOW_STATUSBAR,
     PROP_SHOW_CLOCK,
     PROP_LIMIT_QUALITY,
+    PROP_IMAGE_CACHE_SIZE,
     PROP_HIDE_THUMBNAILS_FULLSCREEN,
     PROP_HIDE_MOUSE_CURSOR_FULLSCREEN_TIMEOUT,
     PROP_WINDOW_WIDTH,
@@ -117,6 +118,7 @@ struct _RsttoSettingsPriv
     gboolean  show_statusbar;
     gboolean  show_clock;
     gboolean  limit_quality;
+    guint     image_cache_size;
     gboolean  hide_thumbnails_fullscreen;
     guint     hide_mouse_cursor_fullscreen_timeout;
     gchar    *navigationbar_position;
@@ -178,6 +180,7 @@ rstto_settings_init (GObject *object)
     }
     
     settings->priv->slideshow_timeout = 5;
+    settings->priv->image_cache_size = 256;
     settings->priv->bgcolor = g_new0 (GdkRGBA, 1);
     settings->priv->bgcolor_fullscreen = g_new0 (GdkRGBA, 1);
     gdk_rgba_parse (settings->priv->bgcolor_fullscreen, "black"); // black by default
@@ -327,6 +330,13 @@ rstto_settings_init (GObject *object)
             settings,
             "limit-quality");
 
+    xfconf_g_property_bind (
+            settings->priv->channel,
+            "/image/cache-size",
+            G_TYPE_UINT,
+            settings,
+            "image-cache-size");
+
     xfconf_g_property_bind (
             settings->priv->channel,
             "/window/use-thunar-properties",
@@ -454,6 +464,20 @@ rstto_settings_class_init (GObjectClass *object_class)
             PROP_LIMIT_QUALITY,
             pspec);
 
+    /* Memory available for decoded images, in MiB */
+    pspec = g_param_spec_uint (
+            "image-cache-size",
+            "",
+            "",
+            0,
+            4096,
+            256,
+            G_PARAM_READWRITE);
+    g_object_class_install_property (
+            object_class,
+            PROP_IMAGE_CACHE_SIZE,
+            pspec);
+
     pspec = g_param_spec_boolean (
             "hide-thumbnails-fullscreen",
             "",
@@ -841,6 +865,9 @@ rstto_settings_set_property    (GObject      *object,
         case PROP_SLIDESHOW_TIMEOUT:
             settings->priv->slideshow_timeout = g_value_get_uint (value);
             break;
+        case PROP_IMAGE_CACHE_SIZE:
+            settings->priv->image_cache_size = g_value_get_uint (value);
+            break;
         case PROP_BGCOLOR_FULLSCREEN:
             color = g_value_get_boxed (value);
             settings->priv->bgcolor_fullscreen->red = color->red;
@@ -926,6 +953,9 @@ rstto_settings_get_property    (GObject    *object,
         case PROP_SLIDESHOW_TIMEOUT:
             g_value_set_uint (value, settings->priv->slideshow_timeout);
             break;
+        case PROP_IMAGE_CACHE_SIZE:
+            g_value_set_uint (value, settings->priv->image_cache_size);
+            break;
         case PROP_BGCOLOR_FULLSCREEN:
             g_value_set_boxed (value, settings->priv->bgcolor_fullscreen);
             break;
@@ -401,7 +401,7 @@ rstto_thumbnailer_queue_request_timer (gpointer user_data)
         {
             file = RSTTO_FILE(iter->data);
             uris[i] = rstto_file_get_uri (file);
-            mimetypes[i] = rstto_file_get_content_type (file);
+            mimetypes[i] = rstto_file_get_known_content_type (file);
         }
         iter = g_slist_next(iter);
         i++;